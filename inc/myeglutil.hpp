@@ -61,9 +61,14 @@ bool attach_eglstate4Win(EGLNativeWindowType _win, EGLNativeDisplayType _dpy,
                             //output
                             egl_state_t &state);
 
+// 离屏context(无窗口)，用于预编译shader等工具。成功后context已是current
+// prepare_PBuffer 使用默认display上的pbuffer surface；
+// prepare_Surfaceless 使用EGL_MESA_platform_surfaceless + EGL_KHR_surfaceless_context，没有任何surface
 bool prepare_PBuffer(int _width, int _height,
                      //output
                      egl_state_t &state);
+bool prepare_Surfaceless(egl_state_t &state);
+void release_eglstate(egl_state_t &state);
 void swapbuffers(const egl_state_t &state);
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -78,7 +83,8 @@ static bool init_eglenv(const std::vector<EGLint> &_config_attribs,
                         const NativeDisplayType &_dpy, const EGLDisplay &_egl_dpy,
                         //output
                         EGLConfig &_cfg,
-                        EGLContext &_ctx)
+                        EGLContext &_ctx,
+                        const EGLint *_ctx_attribs = NULL)
 {
     int i;
 
@@ -133,7 +139,7 @@ static bool init_eglenv(const std::vector<EGLint> &_config_attribs,
     }
 
     _ctx = eglCreateContext(_egl_dpy, _cfg,
-                            EGL_NO_CONTEXT, NULL);
+                            EGL_NO_CONTEXT, _ctx_attribs);
     if (_ctx == EGL_NO_CONTEXT)
     {
         std::cout << "eglCreateContext() failed\n"
@@ -209,6 +215,138 @@ bool attach_eglstate4Win(EGLNativeWindowType _win, EGLNativeDisplayType _dpy,
 }
 
 
+// core profile, the driver returns the highest version compatible with 3.3
+static const EGLint offscreen_ctx_attribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 3,
+    EGL_CONTEXT_MINOR_VERSION, 3,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE};
+
+bool prepare_PBuffer(int _width, int _height,
+                     //output
+                     egl_state_t &state)
+{
+    state.inited = false;
+    std::vector<EGLint> config_attribs{
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE};
+
+    state.dpy = EGL_DEFAULT_DISPLAY;
+    state.egl_dpy = eglGetDisplay(state.dpy);
+    if (state.egl_dpy == EGL_NO_DISPLAY)
+    {
+        std::cout << "eglGetDisplay() failed\n"
+                  << std::endl;
+        return false;
+    }
+    if (false == init_eglenv(config_attribs, state.dpy, state.egl_dpy,
+                             //output
+                             state.cfg, state.ctx, offscreen_ctx_attribs))
+    {
+        std::cout << "init_eglenv fail" << std::endl;
+        return false;
+    }
+
+    const EGLint pbuffer_attribs[] = {
+        EGL_WIDTH, _width,
+        EGL_HEIGHT, _height,
+        EGL_NONE};
+    state.surf = eglCreatePbufferSurface(state.egl_dpy, state.cfg, pbuffer_attribs);
+    if (state.surf == EGL_NO_SURFACE)
+    {
+        std::cout << "eglCreatePbufferSurface() failed\n"
+                  << std::endl;
+        return false;
+    }
+
+    if (!eglMakeCurrent(state.egl_dpy,
+                        state.surf, state.surf, state.ctx))
+    {
+        std::cout << "eglMakeCurrent() failed\n"
+                  << std::endl;
+        return false;
+    }
+
+    state.inited = true;
+    return true;
+}
+
+bool prepare_Surfaceless(egl_state_t &state)
+{
+    state.inited = false;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    auto client_exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (client_exts == NULL || strstr(client_exts, "EGL_MESA_platform_surfaceless") == NULL)
+    {
+        std::cout << "EGL_MESA_platform_surfaceless is not supported" << std::endl;
+        return false;
+    }
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay == NULL)
+        return false;
+
+    state.dpy = EGL_DEFAULT_DISPLAY;
+    state.egl_dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (state.egl_dpy == EGL_NO_DISPLAY)
+    {
+        std::cout << "eglGetPlatformDisplayEXT() failed\n"
+                  << std::endl;
+        return false;
+    }
+
+    // no surface is ever created, any config rendering GL will do
+    std::vector<EGLint> config_attribs{
+        EGL_SURFACE_TYPE, 0,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE};
+    if (false == init_eglenv(config_attribs, state.dpy, state.egl_dpy,
+                             //output
+                             state.cfg, state.ctx, offscreen_ctx_attribs))
+    {
+        std::cout << "init_eglenv fail" << std::endl;
+        // the display may already be initialized
+        release_eglstate(state);
+        return false;
+    }
+
+    state.surf = EGL_NO_SURFACE;
+    if (!eglMakeCurrent(state.egl_dpy,
+                        EGL_NO_SURFACE, EGL_NO_SURFACE, state.ctx))
+    {
+        std::cout << "eglMakeCurrent() failed\n"
+                  << std::endl;
+        release_eglstate(state);
+        return false;
+    }
+
+    state.inited = true;
+    return true;
+#else
+    std::cout << "EGL_MESA_platform_surfaceless is not known to eglext.h" << std::endl;
+    return false;
+#endif
+}
+
+void release_eglstate(egl_state_t &state)
+{
+    if (state.egl_dpy == EGL_NO_DISPLAY)
+        return;
+    eglMakeCurrent(state.egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (state.surf != EGL_NO_SURFACE)
+        eglDestroySurface(state.egl_dpy, state.surf);
+    if (state.ctx != EGL_NO_CONTEXT)
+        eglDestroyContext(state.egl_dpy, state.ctx);
+    eglTerminate(state.egl_dpy);
+    state.surf = EGL_NO_SURFACE;
+    state.ctx = EGL_NO_CONTEXT;
+    state.egl_dpy = EGL_NO_DISPLAY;
+    state.inited = false;
+}
 
 #endif //MYEGL_UTILITY__IMPLEMENTATION
 
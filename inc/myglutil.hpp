@@ -28,15 +28,35 @@
  * 
  * **/
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 // // // glad, include glad *before* glfw
@@ -59,6 +79,11 @@
 #pragma pop_macro("Success")
 
 
+// KHR_parallel_shader_compile, not every loader generates it
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 #ifdef _DEBUG
 constexpr bool is_debug = true;
 #else
@@ -91,16 +116,370 @@ struct IsSameType<T, T>
 
 namespace shaders
 {
+    // 磁盘缓存的根目录。优先使用环境变量 MYGLUTIL_CACHE_DIR，否则为 <temp>/myglutil_cache
+    std::filesystem::path cache_root();
+    // 资源的根目录，烘焙纹理按相对它的路径命名，整个目录搬走后仍能找到。优先使用环境变量 MYGLUTIL_CONTENT_ROOT，否则为当前目录
+    std::filesystem::path content_root();
+
+    // 64-bit FNV-1a, used to build the keys of the on-disk caches
+    std::uint64_t fnv1a(const void *data, std::size_t len, std::uint64_t seed = 14695981039346656037ull);
+    inline std::uint64_t fnv1a(const std::string &s, std::uint64_t seed = 14695981039346656037ull)
+    {
+        return fnv1a(s.data(), s.size(), seed);
+    }
+
+    // 只读的整个文件：支持mmap的平台上映射，否则读入内存
+    class mappedFile_t
+    {
+    public:
+        mappedFile_t() = default;
+        explicit mappedFile_t(const std::filesystem::path &path) { this->open(path); };
+        ~mappedFile_t() { this->close(); };
+        mappedFile_t(const mappedFile_t &) = delete;
+        mappedFile_t &operator=(const mappedFile_t &) = delete;
+
+        bool open(const std::filesystem::path &path);
+        void close();
+        bool valid() const { return this->m_data != nullptr; };
+        const unsigned char *data() const { return this->m_data; };
+        std::size_t size() const { return this->m_size; };
+
+    private:
+        const unsigned char *m_data = nullptr;
+        std::size_t m_size = 0;
+        bool m_mapped = false;
+        std::vector<unsigned char> m_copy;
+    };
+
+    /**
+     * program binary 磁盘缓存。
+     * 首次link成功后通过glGetProgramBinary保存二进制，之后的prog_t::load会先尝试glProgramBinary，
+     * 驱动拒绝时(驱动升级等)删除该缓存文件并回退到完整的compile/link。
+     * key = hash(vert源码, frag源码, GL_VENDOR, GL_RENDERER, GL_VERSION)
+     * 缓存文件位于 cache_root()/programs/<key>.glprog
+     *
+     * usage example:
+     *   shaders::binaryCache_t::instance().set_directory("./progcache");   //optional
+     *   prog.load(vert, frag);
+     *   std::cout << shaders::binaryCache_t::instance().hits() << std::endl;
+     **/
+    class binaryCache_t
+    {
+    public:
+        static binaryCache_t &instance();
+
+        void set_directory(const std::filesystem::path &dir) { this->m_dir = dir; };
+        const std::filesystem::path &directory() const { return this->m_dir; };
+        void set_enabled(bool on) { this->m_enabled = on; };
+        // false when disabled or when the current context exposes no binary formats
+        bool enabled();
+
+        // return a linked program restored from disk, or 0 on miss/reject
+        GLuint load(const std::string &vert_content, const std::string &frag_content);
+        // save the binary of a linked program, return false on failure
+        bool store(GLuint prog, const std::string &vert_content, const std::string &frag_content);
+
+        std::size_t hits() const { return this->m_hits; };
+        std::size_t misses() const { return this->m_misses; };
+        // binaries found on disk but refused by the driver, they are counted as misses too
+        std::size_t rejects() const { return this->m_rejects; };
+        std::size_t stores() const { return this->m_stores; };
+
+    private:
+        binaryCache_t();
+        std::uint64_t key(const std::string &vert_content, const std::string &frag_content) const;
+        std::filesystem::path file_of(std::uint64_t key) const;
+
+        struct header_t
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t format;
+            std::uint64_t key;
+            std::uint64_t length;
+        };
+        constexpr static std::uint32_t VERSION = 1;
+
+        std::filesystem::path m_dir;
+        bool m_enabled = true;
+        int m_formats = -1; // GL_NUM_PROGRAM_BINARY_FORMATS, -1 until queried
+        std::size_t m_hits = 0, m_misses = 0, m_rejects = 0, m_stores = 0;
+    };
+
+    /**
+     * uniform名字 -> location 的扁平hash表(开放寻址, 线性探测)。
+     * 由prog_t在link后通过glGetActiveUniform一次性填充，之后的查找不再调用glGetUniformLocation，
+     * 也不会为查找构造std::string。
+     **/
+    class uniformTable_t
+    {
+    public:
+        struct entry_t
+        {
+            std::string name;
+            GLint location;
+            GLenum type; // GL_FLOAT_MAT4, GL_SAMPLER_2D ...
+            GLint size;  // array size, 1 for non-array uniforms
+            std::uint64_t hash;
+        };
+
+        void clear();
+        void insert(std::string name, GLint location, GLenum type, GLint size);
+        const entry_t *find(std::string_view name) const;
+
+        std::size_t size() const { return this->m_entries.size(); };
+        auto begin() const { return this->m_entries.cbegin(); };
+        auto end() const { return this->m_entries.cend(); };
+
+    private:
+        void rehash(std::size_t slots);
+
+        std::vector<entry_t> m_entries;
+        std::vector<std::int32_t> m_slots; // index into m_entries, -1 means empty. size is a power of two
+    };
+
+    /**
+     * GL对象的move-only所有权封装，析构时删除对象。可以隐式转换为GLuint，直接传给gl函数。
+     *
+     * usage example:
+     *   shaders::glBuffer_t vbo = shaders::glBuffer_t::create();
+     *   glBindBuffer(GL_ARRAY_BUFFER, vbo);
+     *   meshVbos.push_back(std::move(vbo));
+     **/
+    template <typename traits_t>
+    class glHandle_t
+    {
+    public:
+        glHandle_t() = default;
+        explicit glHandle_t(GLuint id) : m_id(id){};
+        ~glHandle_t() { this->reset(); };
+        glHandle_t(const glHandle_t &) = delete;
+        glHandle_t &operator=(const glHandle_t &) = delete;
+        glHandle_t(glHandle_t &&other) noexcept : m_id(other.release()){};
+        glHandle_t &operator=(glHandle_t &&other) noexcept
+        {
+            if (this != &other)
+                this->reset(other.release());
+            return *this;
+        };
+
+        static glHandle_t create() { return glHandle_t(traits_t::create()); };
+
+        GLuint get() const { return this->m_id; };
+        operator GLuint() const { return this->m_id; };
+        // give up ownership without deleting
+        GLuint release() { return std::exchange(this->m_id, 0); };
+        void reset(GLuint id = 0)
+        {
+            if (this->m_id != 0)
+                traits_t::destroy(this->m_id);
+            this->m_id = id;
+        };
+
+    private:
+        GLuint m_id = 0;
+    };
+
+    struct bufferTraits_t
+    {
+        static GLuint create()
+        {
+            GLuint id = 0;
+            glGenBuffers(1, &id);
+            return id;
+        };
+        static void destroy(GLuint id) { glDeleteBuffers(1, &id); };
+    };
+    struct vertexArrayTraits_t
+    {
+        static GLuint create()
+        {
+            GLuint id = 0;
+            glGenVertexArrays(1, &id);
+            return id;
+        };
+        static void destroy(GLuint id) { glDeleteVertexArrays(1, &id); };
+    };
+    struct textureTraits_t
+    {
+        static GLuint create()
+        {
+            GLuint id = 0;
+            glGenTextures(1, &id);
+            return id;
+        };
+        static void destroy(GLuint id) { glDeleteTextures(1, &id); };
+    };
+    struct programTraits_t
+    {
+        static GLuint create() { return glCreateProgram(); };
+        static void destroy(GLuint id) { glDeleteProgram(id); };
+    };
+    using glBuffer_t = glHandle_t<bufferTraits_t>;
+    using glVertexArray_t = glHandle_t<vertexArrayTraits_t>;
+    using glTexture_t = glHandle_t<textureTraits_t>;
+    using glProgram_t = glHandle_t<programTraits_t>;
+
+    /**
+     * 进程内的纹理表：同一图片(规范化的绝对路径 + 加载参数)只解码、上传一次，所有model_t共享同一个GL纹理。
+     * acquire返回引用计数的句柄，最后一个句柄释放时纹理随之删除(须在GL线程)，表中只保存weak_ptr。
+     * 图片在threadPool_t上直接解码进映射的pixel unpack buffer，GL线程只做映射和glTexSubImage2D，
+     * 因此一次acquire多个文件时所有核一起解码。
+     * usage example:
+     *   auto &registry = shaders::textureRegistry_t::instance();
+     *   auto tex = registry.acquire("resources/textures/marble.jpg");
+     *   glBindTexture(GL_TEXTURE_2D, *tex);
+     *   auto all = registry.acquire(files);   // 批量，并行解码
+     *
+     * 纹理烘焙：cook解码图片，在CPU上生成完整的mip链(2x2盒式滤波，gamma时RGB在线性空间平均)，按最终的GL内部格式写入
+     * cooked_file(file)，即cache_root()/textures/<key>.gltex(类似KTX2：头 + 每级的offset/长度 + 16字节对齐的各级数据)。
+     * key取图片相对content_root()的路径(根目录之外的图片取绝对路径)，离线烘焙的缓存随资源目录一起搬走后仍然有效。
+     * cook不需要GL，可以离线在工具或工作线程中调用。acquire遇到比源文件新的烘焙文件(或源文件已不存在)时直接mmap，
+     * 整条mip链memcpy进PBO后用glTexStorage2D/glTexSubImage2D上传，不再解码，也不调用glGenerateMipmap；
+     * cooking为true时，从源文件加载的图片顺便在工作线程上烘焙。
+     *   registry.cook("resources/textures/marble.jpg");   // 离线
+     **/
+    class textureRegistry_t
+    {
+    public:
+        using handle_t = std::shared_ptr<const glTexture_t>;
+
+        /**
+         * 一批一起加载的图片，acquire依次执行下面四步；异步加载时可以把各步分别放到工作线程和uploadQueue_t上：
+         *   prepare(任意线程): 规范化路径，已加载的直接取得句柄，其余读取图片头
+         *   map(GL线程): 为其余图片分配一个PBO并映射
+         *   decode(任意线程): 在threadPool_t上解码进映射的内存
+         *   finish(GL线程): 解除映射，从PBO创建纹理并登记
+         * batch持有GL对象，必须在GL线程上销毁。
+         **/
+        struct batch_t
+        {
+            struct item_t
+            {
+                std::filesystem::path file;
+                std::string key;
+                bool gamma = false;
+                int width = 0, height = 0, components = 0; // 0 when the header cannot be read
+                int levels = 0;                            // the whole mip chain
+                bool cooked = false;                       // read from cooked_file instead of the source
+                std::size_t offset = 0;                    // into the mapped buffer, the levels follow each other
+                std::ptrdiff_t alias = -1;                 // an earlier item with the same key
+                bool decoded = false;
+                handle_t texture; // files already loaded get it in prepare/map, the others in finish
+            };
+            std::vector<item_t> items;
+            std::size_t bytes = 0; // staging the items need at most, set by split
+            glBuffer_t pbo;
+            unsigned char *mapped = nullptr;
+        };
+
+        static textureRegistry_t &instance();
+
+        // gamma[i] tells whether files[i] is sRGB
+        batch_t prepare(const std::vector<std::filesystem::path> &files, const std::vector<bool> &gamma);
+        batch_t prepare(const std::vector<std::filesystem::path> &files, bool gamma = false)
+        {
+            return this->prepare(files, std::vector<bool>(files.size(), gamma));
+        };
+        void map(batch_t &batch);
+        static void decode(batch_t &batch);
+        void finish(batch_t &batch);
+
+        // GL thread. a file that cannot be decoded still yields an (empty) texture object, and is not retried while in use
+        std::vector<handle_t> acquire(const std::vector<std::filesystem::path> &files, const std::vector<bool> &gamma);
+        std::vector<handle_t> acquire(const std::vector<std::filesystem::path> &files, bool gamma = false)
+        {
+            return this->acquire(files, std::vector<bool>(files.size(), gamma));
+        };
+        handle_t acquire(const std::filesystem::path &file, bool gamma = false) { return this->acquire(std::vector<std::filesystem::path>{file}, gamma)[0]; };
+
+        // textures still referenced
+        std::size_t size() const;
+        std::size_t hits() const { return this->m_hits; };
+        std::size_t misses() const { return this->m_misses; };
+
+        // staging memory mapped at a time by acquire and loadModelAsync, a larger image still gets a batch of its own
+        constexpr static std::size_t stagingBytes = std::size_t(128) << 20;
+        // any thread: the items of a prepared batch in order, in batches of at most budget staging bytes
+        static std::vector<batch_t> split(batch_t &&all, std::size_t budget = stagingBytes);
+
+        // any thread, no GL: write the cooked texture of file, false when it cannot be decoded or written
+        static bool cook(const std::filesystem::path &file, bool gamma = false);
+        static std::filesystem::path cooked_file(const std::filesystem::path &file, bool gamma = false);
+        // cook the files acquire decodes from the source
+        std::atomic<bool> cooking{true};
+        // textures acquired from cooked files
+        std::size_t cooked_loads() const { return this->m_cookedLoads; };
+
+    private:
+        textureRegistry_t() = default;
+        // the live texture of key, counts a hit
+        handle_t find(const std::string &key);
+        static std::string key_of(const std::filesystem::path &file, bool gamma);
+
+        // layout of the cooked texture file, see cook
+        struct cookedHeader_t
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t internalFormat, format, type; // as passed to glTexStorage2D / glTexSubImage2D
+            std::uint32_t width, height, components, levels;
+        };
+        struct cookedLevel_t
+        {
+            std::uint64_t offset, bytes; // from the start of the file
+        };
+        constexpr static std::uint32_t COOKED_VERSION = 1;
+        static GLenum pixel_format(int components);
+        static GLenum internal_format(int components, bool gamma);
+        static int mip_levels(int width, int height);
+        static std::size_t level_bytes(int width, int height, int components, int level);
+        static std::size_t chain_bytes(int width, int height, int components, int levels);
+        // the header of a cooked file that is not older than its source
+        static bool cooked_header(const std::filesystem::path &file, bool gamma, cookedHeader_t &hdr);
+        // level 0 followed by the box filtered levels, tightly packed
+        static std::vector<unsigned char> build_mips(const unsigned char *pixels, int width, int height, int components, bool gamma);
+        static bool write_cooked(const std::filesystem::path &file, bool gamma, int width, int height, int components,
+                                 const std::vector<unsigned char> &chain);
+        static bool storage_supported();
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, std::weak_ptr<const glTexture_t>> m_textures;
+        std::size_t m_hits = 0, m_misses = 0;
+        std::atomic<std::size_t> m_cookedLoads{0};
+    };
+
     class prog_t
     {
     public:
         GLuint progid = 0;
 
-        ~prog_t() { this->del_program(); };
+        prog_t() = default;
+        ~prog_t();
+        // move-only: progid and the hot reload registration follow the object
+        prog_t(const prog_t &) = delete;
+        prog_t &operator=(const prog_t &) = delete;
+        prog_t(prog_t &&other) noexcept;
+        prog_t &operator=(prog_t &&other) noexcept;
         bool use();
 
         bool loadFromPath(const std::filesystem::path &vert_path, const std::filesystem::path &frag_path);
         bool load(const std::string &vert_content, const std::string &frag_content);
+        // 读取整个shader文件，失败返回空串
+        static std::basic_string<GLchar> readShader_fromfile(const std::filesystem::path &_path);
+
+        // 返回uniform的location(整数句柄)，不存在时返回-1。只查询link时反射得到的表，不会调用glGetUniformLocation
+        GLint uniform_location(std::string_view name) const
+        {
+            auto e = this->m_uniforms.find(name);
+            return e == nullptr ? -1 : e->location;
+        };
+        const uniformTable_t &uniforms() const { return this->m_uniforms; };
+
+        // prog_t保存了每个uniform当前值的副本(shadow)，值未改变的uniform_set不会调用glUniform*
+        std::size_t uploads_issued() const { return this->m_uploadsIssued; };
+        std::size_t uploads_skipped() const { return this->m_uploadsSkipped; };
+        void reset_upload_counters() { this->m_uploadsIssued = this->m_uploadsSkipped = 0; };
 
         /**
          * usage example:
@@ -109,154 +488,1143 @@ namespace shaders
          *           lightingShader_prog.uniform_set<Eigen::Vector3f>(
          *               {{"light.position", lightPos},
          *               {"material.specular", Eigen::Vector3f(0.5f, 0.5f, 0.5f)}});
-         * 
+         *
          **/
         template <typename T>
         void uniform_set(std::initializer_list<std::tuple<std::string /*name*/, T>> lists)
         {
             for (auto &v : lists)
             {
-                GLuint loc = glGetUniformLocation(this->progid, std::get<0>(v).c_str());
+                GLint loc = this->uniform_location(std::get<0>(v));
                 if (loc == -1)
                 {
                     std::cout << std::get<0>(v) << ": uniform is not in program[" << this->progid << "]" << std::endl;
                     continue;
                 }
-                static_assert(IsSameType<T, Eigen::Matrix4f>::result ||
-                                  IsSameType<T, Eigen::Vector3f>::result ||
-                                  std::is_integral<T>::value ||
-                                  IsSameType<T, GLfloat>().result,
-                              "-not supported-");
+                this->uniform_upload(loc, std::get<1>(v));
+            }
+            return;
+        };
+
+        /**
+         * 通过整数句柄设置uniform，句柄来自uniform_location()，可在初始化时取得后长期保存。
+         * usage example:
+         *   GLint modelLoc = prog.uniform_location("model");
+         *   ...
+         *   prog.uniform_set<Eigen::Matrix4f>({{modelLoc, model.matrix()}});
+         **/
+        template <typename T>
+        void uniform_set(std::initializer_list<std::tuple<GLint /*location*/, T>> lists)
+        {
+            for (auto &v : lists)
+            {
+                if (std::get<0>(v) == -1)
+                    continue;
+                this->uniform_upload(std::get<0>(v), std::get<1>(v));
+            }
+            return;
+        };
+        template <typename T>
+        void uniform_set(GLint location, const T &value)
+        {
+            if (location == -1)
+                return;
+            this->uniform_upload(location, value);
+        };
+
+    private:
+        template <typename T>
+        void uniform_upload(GLint loc, const T &d)
+        {
+            static_assert(IsSameType<T, Eigen::Matrix4f>::result ||
+                              IsSameType<T, Eigen::Vector3f>::result ||
+                              std::is_integral<T>::value ||
+                              IsSameType<T, GLfloat>().result,
+                          "-not supported-");
+
+            // the value as the program stores it, compared against the shadow copy
+            GLint ival = 0;
+            const void *bytes = &ival;
+            std::size_t len = sizeof(GLint);
+            if constexpr (std::is_integral<T>::value)
+                ival = static_cast<GLint>(d);
+            else if constexpr (IsSameType<T, GLfloat>::result)
+                bytes = &d, len = sizeof(GLfloat);
+            else
+                bytes = d.data(), len = sizeof(GLfloat) * d.size();
+            if (this->shadow_unchanged(loc, bytes, len))
+            {
+                this->m_uploadsSkipped++;
+                return;
+            }
+            this->m_uploadsIssued++;
 
+            // stage programs of a pipeline_t are never bound with glUseProgram, address them directly
+            if (this->m_separable)
+            {
                 if constexpr (IsSameType<T, Eigen::Vector3f>().result)
-                {
-                    auto &&d = std::get<1>(v);
-                    glUniform3f(loc, d.x(), d.y(), d.z());
-                }
+                    glProgramUniform3f(this->progid, loc, d.x(), d.y(), d.z());
                 else if constexpr (IsSameType<T, Eigen::Matrix4f>::result)
-                {
-                    glUniformMatrix4fv(loc, 1, GL_FALSE, std::get<1>(v).data());
-                }
+                    glProgramUniformMatrix4fv(this->progid, loc, 1, GL_FALSE, d.data());
                 else if constexpr (IsSameType<T, GLfloat>::result)
-                {
-                    glUniform1f(loc, std::get<1>(v));
-                }
+                    glProgramUniform1f(this->progid, loc, d);
                 else if constexpr (std::is_integral<T>::value)
-                {
-                    glUniform1i(loc, std::get<1>(v));
-                }
+                    glProgramUniform1i(this->progid, loc, ival);
+                return;
+            }
+
+            if constexpr (IsSameType<T, Eigen::Vector3f>().result)
+            {
+                glUniform3f(loc, d.x(), d.y(), d.z());
+            }
+            else if constexpr (IsSameType<T, Eigen::Matrix4f>::result)
+            {
+                glUniformMatrix4fv(loc, 1, GL_FALSE, d.data());
+            }
+            else if constexpr (IsSameType<T, GLfloat>::result)
+            {
+                glUniform1f(loc, d);
+            }
+            else if constexpr (std::is_integral<T>::value)
+            {
+                glUniform1i(loc, ival);
             }
-            return;
         };
 
-    private:
+        // true when location already holds these bytes; otherwise the shadow copy is updated
+        bool shadow_unchanged(GLint loc, const void *bytes, std::size_t len);
+
+        // fill m_uniforms from the active uniforms of progid
+        void reflect();
+
         GLuint create_link_program(std::string vert_glsl, std::string frag_glsl);
         void del_program();
+        // delete the program and any in-flight reload, drop the watcher registration
+        void release();
+
+        // compile/link without querying any status, so that the driver may work in the background
+        static GLuint link_begin(const std::string &vert_glsl, const std::string &frag_glsl);
+        static GLuint compile_begin(GLenum type, const std::string &glsl);
+        static GLuint link_begin(const GLuint *shaders, int count);
+        // false while KHR_parallel_shader_compile still works on prog
+        static bool link_ready(GLuint prog);
+        // check compile/link status (printing the logs), release the shader objects. the program is deleted on failure
+        static bool link_end(GLuint &prog);
+
+        // take over a linked program (replacing progid), store it in the binary cache and reflect it
+        void adopt(GLuint prog, const std::string &vert_content, const std::string &frag_content, bool from_cache);
+
+        friend class progBatch_t;
+        friend class stageCache_t;
+        bool m_separable = false; // single stage program from glCreateShaderProgramv
+        friend class shaderWatcher_t;
+        friend class shaderVariants_t;
+        // hot reload, driven by shaderWatcher_t::poll() on the GL thread.
+        // rebuild_t produces the new sources and the files they were read from
+        using rebuild_t = std::function<bool(std::string &vert, std::string &frag, std::vector<std::filesystem::path> &files)>;
+        std::vector<std::filesystem::path> m_watched; // absolute paths, empty when not watched
+        rebuild_t m_rebuild;
+        void watch_files(std::vector<std::filesystem::path> files, rebuild_t rebuild);
+        struct reload_t
+        {
+            GLuint prog = 0;
+            std::string vert, frag;
+        } m_reload;
+        void reload_begin(std::string vert_content, std::string frag_content);
+        void reload_poll();
 
-    private:
-        std::basic_string<GLchar> readShader_fromfile(const std::filesystem::path &_path);
-    };
+        uniformTable_t m_uniforms;
 
-    // 顶点数据类型
-    enum class vertexType_t
-    {
-        POSITION_ENU,
-        NORMAL_ENU,
-        TEXCOORD_ENU,
-        TANGENT_ENU,
-        BITTANGENT_ENU
+        struct shadow_t
+        {
+            std::uint8_t size = 0; // 0: value unknown
+            alignas(4) unsigned char bytes[64];
+        };
+        std::vector<shadow_t> m_shadow; // indexed by uniform location
+        std::size_t m_uploadsIssued = 0, m_uploadsSkipped = 0;
     };
 
-    class mesh_t
+    /**
+     * 批量编译。先把程序需要的所有program加入队列，start()一次性提交全部compile，再提交全部link，
+     * 期间不查询任何状态，驱动可以用它的编译线程并行工作。之后finish()阻塞地检查结果，
+     * 或每帧调用poll()，通过GL_COMPLETION_STATUS_KHR非阻塞地完成已就绪的program。
+     * binary cache中已有的program在start()中直接恢复。
+     *
+     * usage example:
+     *   shaders::progBatch_t batch;
+     *   batch.add(lightingShader_prog, vert1, frag1);
+     *   batch.add(lightCubeShader_prog, vert2, frag2);
+     *   batch.start();
+     *   ...               //其他初始化工作，例如加载模型
+     *   batch.finish();   //或者每帧 if (batch.poll()) ...
+     **/
+    class progBatch_t
     {
-        
     public:
-        struct vertex_t //= struct //__Vertex
+        using clock_t = std::chrono::steady_clock;
+
+        // prog must outlive the batch
+        void add(prog_t &prog, std::string vert_content, std::string frag_content);
+        void start();
+        // complete the programs that are ready without blocking. true when nothing is pending anymore
+        bool poll();
+        // complete everything, blocking. false if any program failed
+        bool finish();
+
+        std::size_t size() const { return this->m_items.size(); };
+        std::size_t pending() const;
+        std::size_t failed() const;
+
+        enum class state_t
         {
-            // position
-            Eigen::Vector3f Position;
-            // normal
-            Eigen::Vector3f Normal;
-            // texCoords
-            Eigen::Vector2f TexCoords;
-            // tangent
-            Eigen::Vector3f Tangent;
-            // bitangent
-            Eigen::Vector3f Bitangent;
+            QUEUED,
+            COMPILING,
+            LINKING,
+            DONE,
+            FAILED
         };
-
-        struct texture_t //= struct //__Texture
+        struct item_t
         {
-            GLuint id;
-            std::string type;
-            std::string path;
+            prog_t *prog = nullptr;
+            std::string vert, frag;
+            state_t state = state_t::QUEUED;
+            GLuint shaders[2] = {0, 0};
+            GLuint linking = 0;
+            bool cached = false;         // restored from binaryCache_t
+            clock_t::time_point start;   // submission time
+            clock_t::duration elapsed{}; // submission -> done/failed
         };
+        const std::vector<item_t> &items() const { return this->m_items; };
+
+    private:
+        void complete(item_t &it);
+        std::vector<item_t> m_items;
+    };
 
+    /**
+     * GLSL预处理 + shader变体(permutation)缓存。
+     * preprocess()展开 #include "file" / #include <file>(先相对当前文件查找，再依次查找include目录和
+     * add_virtual_file()登记的内存文件，支持 #pragma once)，并在 #version 之后注入 #define。
+     * 注入和展开后会插入 #line，编译错误中的行号仍对应原文件，第二个数字是files()中的文件序号。
+     * get()以(源码, define集合)为key返回缓存的prog_t，首次使用时才编译；precompile()用progBatch_t批量预编译。
+     * define的先后顺序不影响key。
+     *
+     * usage example:
+     *   shaders::shaderVariants_t variants;
+     *   variants.add_include_dir("../../resources/shaders");
+     *   auto prog = variants.getFromPath("textured.vert", "textured.frag", {{"HAS_TEXTURE", "1"}});
+     *   if (prog) { prog->use(); ...}
+     **/
+    class shaderVariants_t
+    {
     public:
-        // mesh Data
-        std::vector<vertex_t> vertices;
-        std::vector<GLuint> indices;
-        std::vector<texture_t> textures;
-        GLuint VAO;
-        // constructor
-        mesh_t(const std::vector<vertex_t> &_vertices, const std::vector<GLuint> &_indices,
-               const std::vector<texture_t> &_textures);
+        using defines_t = std::vector<std::pair<std::string /*name*/, std::string /*value*/>>;
 
-        // render the mesh
-        void Draw(shaders::prog_t &shader);
+        shaderVariants_t() = default;
+        // the hot reload of a variant calls back into the object that built it
+        shaderVariants_t(const shaderVariants_t &) = delete;
+        shaderVariants_t &operator=(const shaderVariants_t &) = delete;
+
+        void add_include_dir(const std::filesystem::path &dir) { this->m_includeDirs.push_back(dir); };
+        void add_virtual_file(const std::string &name, std::string content) { this->m_virtualFiles[name] = std::move(content); };
+
+        // origin: path of the source, used to resolve relative includes. the defines are emitted sorted.
+        // return empty string on error
+        std::string preprocess(const std::string &source, const defines_t &defines,
+                               const std::filesystem::path &origin = {},
+                               std::vector<std::string> *files = nullptr) const;
+
+        // nullptr when the variant failed to build (the failure is cached as well)
+        prog_t *get(const std::string &vert_source, const std::string &frag_source, const defines_t &defines = {});
+        prog_t *getFromPath(const std::filesystem::path &vert_path, const std::filesystem::path &frag_path,
+                            const defines_t &defines = {});
+
+        struct variant_t
+        {
+            std::string vert, frag; // unexpanded source
+            std::filesystem::path vert_origin, frag_origin;
+            defines_t defines;
+        };
+        // build a list of variants up front with one progBatch_t, return the number of failures
+        std::size_t precompile(const std::vector<variant_t> &variants);
+
+        std::size_t size() const { return this->m_programs.size(); };
 
     private:
-        // render data
-        GLuint VBO, EBO;
+        std::uint64_t key(const std::string &vert_source, const std::string &frag_source, const defines_t &defines) const;
+        bool expand(const std::string &text, const std::filesystem::path &dir, int id, int firstline, int depth,
+                    std::string &out, std::vector<std::string> &files, std::vector<std::string> &onces) const;
+        bool resolve(const std::string &name, bool quoted, const std::filesystem::path &dir,
+                     std::string &content, std::string &resolved) const;
+        prog_t *build(std::uint64_t k, const variant_t &v);
+        // register the files a variant read from disk with shaderWatcher_t, the stage sources first
+        void watch(prog_t &prog, const variant_t &v, const std::vector<std::string> &vfiles,
+                   const std::vector<std::string> &ffiles);
+        std::vector<std::filesystem::path> on_disk(const std::vector<std::string> &vfiles,
+                                                   const std::vector<std::string> &ffiles) const;
+
+        std::vector<std::filesystem::path> m_includeDirs;
+        std::unordered_map<std::string, std::string> m_virtualFiles;
+        std::unordered_map<std::uint64_t, std::unique_ptr<prog_t>> m_programs;
+    };
+
+    /**
+     * 可分离(separable)的单阶段program缓存，ARB_separate_shader_objects / GL 4.1。
+     * 每个阶段的源码只通过glCreateShaderProgramv编译一次，以(阶段, 源码hash)为key在进程内共享，
+     * 由pipeline_t组合成program pipeline。N个材质共用一个vertex shader时只编译一次vertex阶段。
+     * 注意：separable的vertex shader需要重新声明gl_PerVertex，例如
+     *     out gl_PerVertex { vec4 gl_Position; };
+     **/
+    class stageCache_t
+    {
+    public:
+        static stageCache_t &instance();
+        // true when the context supports separate shader objects
+        static bool supported();
+
+        // nullptr when the stage fails to compile
+        std::shared_ptr<prog_t> get(GLenum type, const std::string &source);
+        // drop the stages no pipeline uses anymore
+        void purge();
 
-        // initializes all the buffer objects/arrays
-        void setupMesh();
+        std::size_t compiles() const { return this->m_compiles; };
+        std::size_t hits() const { return this->m_hits; };
+
+    private:
+        stageCache_t() = default;
+        std::unordered_map<std::uint64_t, std::shared_ptr<prog_t>> m_stages;
+        std::size_t m_compiles = 0, m_hits = 0;
     };
 
     /**
-     * 可加载原始数据，或任何assimp支持的规范化模型数据。
-     * 加载的顶点数据属性位置，固定为以下属性位置。因此在书写GLSL时填写属性位置，或在其他地方指定属性位置时必须按照
-     * 下面的属性位置约定进行编码，该约定固定编码在mesh_t.setupMesh()中： 
-     *        0: vertex positon;        1:vertex normals; 
-     *        2: vextex texture coords; 3: vertex tangent
-     *        4: vertex bitangent
-     * 同时约定：上述这些顶点数据，除了`texture coords是vec2外，其他顶点数据都是vec3
-    */
-    class model_t
+     * program pipeline，由stageCache_t中的阶段组合而成。use()绑定pipeline(同时解除glUseProgram的program)。
+     * 各阶段的uniform通过vertex()/fragment()设置(内部使用glProgramUniform*，不需要绑定)；
+     * uniform_set会把值写到所有包含该uniform的阶段。
+     * model_t::Draw(pipeline.fragment())设置sampler。
+     *
+     * usage example:
+     *   shaders::pipeline_t pipe;
+     *   pipe.load(common_vert, material_frag);
+     *   pipe.use();
+     *   pipe.uniform_set<Eigen::Matrix4f>({{"model", model.matrix()}});
+     *   cubeModel.Draw(pipe.fragment());
+     **/
+    class pipeline_t
     {
-        struct boneInfo_t //= struct __BoneInfo
+    public:
+        GLuint pipelineid = 0;
+
+        pipeline_t() = default;
+        ~pipeline_t();
+        pipeline_t(const pipeline_t &) = delete;
+        pipeline_t &operator=(const pipeline_t &) = delete;
+
+        bool load(const std::string &vert_content, const std::string &frag_content);
+        bool use();
+
+        prog_t &vertex() { return *this->m_vert; };
+        prog_t &fragment() { return *this->m_frag; };
+
+        template <typename T>
+        void uniform_set(std::initializer_list<std::tuple<std::string /*name*/, T>> lists)
         {
-            /*
-        	For uniquely indentifying the bone and
-		    for indexing bone transformation in shaders
-            */
-            int id;
-            /*
-		    map from bone name to offset matrix.
-		    offset matrix transforms bone from bone space to local space
-	        */
-            Eigen::Matrix4f offset;
+            for (auto &v : lists)
+            {
+                bool found = false;
+                for (prog_t *stage : {this->m_vert.get(), this->m_frag.get()})
+                {
+                    GLint loc = stage == nullptr ? -1 : stage->uniform_location(std::get<0>(v));
+                    if (loc == -1)
+                        continue;
+                    stage->uniform_set<T>(loc, std::get<1>(v));
+                    found = true;
+                }
+                if (found == false)
+                    std::cout << std::get<0>(v) << ": uniform is not in pipeline[" << this->pipelineid << "]" << std::endl;
+            }
         };
 
+    private:
+        std::shared_ptr<prog_t> m_vert, m_frag;
+    };
+
+    /**
+     * shader热加载。通过prog_t::loadFromPath或shaderVariants_t::getFromPath创建的program会登记其源文件
+     * (变体还包括#include的文件)，start()后后台线程用inotify监视这些文件所在目录。
+     * 渲染线程在每帧开始(帧边界)调用poll()：对改变的program发起编译/链接但不等待结果，
+     * 之后各帧通过GL_COMPLETION_STATUS_KHR(KHR_parallel_shader_compile)非阻塞地查询，
+     * 链接成功后才替换progid；编译失败时打印日志并保留旧program。
+     * 变体按原来的defines重新预处理。
+     * 没有KHR_parallel_shader_compile时状态查询推迟到下一帧，且会阻塞渲染线程直到链接完成，
+     * start()会打印提示，parallel()返回false。
+     * 仅linux(inotify)下有效，其他平台start()返回false。
+     *
+     * usage example:
+     *   shaders::shaderWatcher_t::instance().start();
+     *   prog.loadFromPath("shader.vert", "shader.frag");
+     *   ...
+     *   //每帧开始，context为current时
+     *   shaders::shaderWatcher_t::instance().poll();
+     **/
+    class shaderWatcher_t
+    {
     public:
-        // model data
-        std::vector<mesh_t::texture_t> textures_loaded; // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-        std::vector<mesh_t> meshes;
-        std::string directory;
-        bool gammaCorrection;
+        static shaderWatcher_t &instance();
+        ~shaderWatcher_t() { this->stop(); };
 
-        // constructor, expects a filepath to a 3D model.
-        model_t(bool gamma = false) : gammaCorrection(gamma){};
+        bool start();
+        void stop();
+        bool running() const { return this->m_thread.joinable(); };
+        // false when the context has no parallel shader compile, reloads then stall the frame that checks the link
+        bool parallel() const { return this->m_parallel; };
 
-        // draws the model, and thus all its meshes
-        void Draw(shaders::prog_t &shader);
+        // call on the GL thread at a frame boundary
+        void poll();
 
-        auto &GetOffsetMatMap() { return m_OffsetMatMap; }
-        int &GetBoneCount() { return m_BoneCount; }
+        std::size_t reloads() const { return this->m_reloads; };
+        std::size_t failures() const { return this->m_failures; };
 
-        // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-        void loadModel(const std::filesystem::path &path);
-        /**
+    private:
+        friend class prog_t;
+        shaderWatcher_t() = default;
+
+        void watch(prog_t *prog);
+        void unwatch(prog_t *prog);
+        void add_watch_locked(const std::filesystem::path &dir);
+        void run();
+
+        std::mutex m_mutex;
+        std::vector<prog_t *> m_progs;
+        // watched files written since the last poll() (and not empty, saves truncate first)
+        std::unordered_set<std::string> m_changed;
+        std::unordered_map<std::string, int> m_files; // watched file -> number of programs using it
+        std::unordered_map<int, std::filesystem::path> m_dirs; // inotify watch descriptor -> directory
+        int m_fd = -1;
+        std::atomic<bool> m_stop{false};
+        std::thread m_thread;
+        std::size_t m_reloads = 0, m_failures = 0;
+        bool m_parallel = false;
+    };
+
+    // GL_EXTENSIONS contains name, queried once per process
+    bool has_extension(std::string_view name);
+
+    /**
+     * 按std140布局组织的uniform buffer block，所有声明了同名block的program共享同一份数据。
+     * create()后block登记到全局表中，之后link的prog_t会自动调用glUniformBlockBinding绑定到该binding point；
+     * 对create()之前已经加载的program，调用attach(prog)。
+     * 每帧只需set()各成员后调用一次upload()，不再需要逐program设置uniform。
+     *
+     * usage example:
+     *   GLSL:   layout (std140) uniform Camera { mat4 projection; mat4 view; };
+     *
+     *   shaders::uniformBlock_t camera("Camera", 0);
+     *   camera.declare<Eigen::Matrix4f>("projection").declare<Eigen::Matrix4f>("view");
+     *   camera.create();
+     *   ...
+     *   camera.set("projection", projection);
+     *   camera.set("view", view);
+     *   camera.upload();
+     **/
+    class uniformBlock_t
+    {
+    public:
+        uniformBlock_t(std::string blockname, GLuint binding)
+            : m_name(std::move(blockname)), m_binding(binding){};
+        ~uniformBlock_t();
+        uniformBlock_t(const uniformBlock_t &) = delete;
+        uniformBlock_t &operator=(const uniformBlock_t &) = delete;
+
+        // append a member, following the std140 base alignment/stride rules. count > 1 declares an array
+        template <typename T>
+        uniformBlock_t &declare(const std::string &member, GLint count = 1)
+        {
+            static_assert(IsSameType<T, Eigen::Matrix4f>::result ||
+                              IsSameType<T, Eigen::Matrix3f>::result ||
+                              IsSameType<T, Eigen::Vector4f>::result ||
+                              IsSameType<T, Eigen::Vector3f>::result ||
+                              IsSameType<T, Eigen::Vector2f>::result ||
+                              IsSameType<T, GLint>::result ||
+                              IsSameType<T, GLfloat>::result,
+                          "-not supported-");
+
+            member_t m;
+            m.name = member;
+            m.count = std::max(count, 1);
+            if constexpr (IsSameType<T, Eigen::Matrix4f>::result)
+                m.align = 16, m.size = 64, m.columns = 4, m.rows = 4;
+            else if constexpr (IsSameType<T, Eigen::Matrix3f>::result)
+                m.align = 16, m.size = 48, m.columns = 3, m.rows = 3; // every column is padded to a vec4
+            else if constexpr (IsSameType<T, Eigen::Vector4f>::result)
+                m.align = 16, m.size = 16, m.columns = 1, m.rows = 4;
+            else if constexpr (IsSameType<T, Eigen::Vector3f>::result)
+                m.align = 16, m.size = 12, m.columns = 1, m.rows = 3;
+            else if constexpr (IsSameType<T, Eigen::Vector2f>::result)
+                m.align = 8, m.size = 8, m.columns = 1, m.rows = 2;
+            else
+                m.align = 4, m.size = 4, m.columns = 1, m.rows = 1;
+
+            // array elements (and their alignment) are rounded up to a vec4
+            if (m.count > 1)
+                m.align = 16;
+            m.stride = m.count > 1 ? (m.size + 15) / 16 * 16 : m.size;
+            m.offset = (this->m_size + m.align - 1) / m.align * m.align;
+            this->m_size = m.offset + m.stride * m.count;
+            this->m_members.push_back(m);
+            return *this;
+        };
+
+        // allocate the buffer and bind it to the binding point, call with a current context
+        bool create(GLenum usage = GL_DYNAMIC_DRAW);
+        // bind the block of an already loaded program to this binding point
+        bool attach(const prog_t &prog) const;
+
+        // write a member into the CPU side copy, it reaches the GPU at the next upload()
+        template <typename T>
+        bool set(std::string_view member, const T &value, GLint index = 0)
+        {
+            if (this->m_data.empty())
+                return false; // not created yet
+            auto m = this->find(member);
+            if (m == nullptr || index < 0 || index >= m->count)
+            {
+                std::cout << member << ": member is not in uniform block[" << this->m_name << "]" << std::endl;
+                return false;
+            }
+            auto dst = this->m_data.data() + m->offset + m->stride * index;
+            if constexpr (std::is_arithmetic<T>::value)
+            {
+                static_assert(sizeof(T) == 4, "-not supported-");
+                std::memcpy(dst, &value, sizeof(T));
+            }
+            else
+            {
+                // Eigen matrices are column major; std140 places each column at a 16 bytes boundary
+                static_assert(T::IsRowMajor == false || T::ColsAtCompileTime == 1, "-not supported-");
+                if (value.rows() != m->rows || value.cols() != m->columns)
+                    return false;
+                const GLint colstride = m->columns > 1 ? 16 : 0;
+                for (GLint c = 0; c < m->columns; c++)
+                    std::memcpy(dst + colstride * c, value.data() + m->rows * c, m->rows * sizeof(GLfloat));
+            }
+            this->mark_dirty(m->offset + m->stride * index, m->stride);
+            return true;
+        };
+
+        // push the modified byte range with a single glBufferSubData
+        void upload();
+
+        const std::string &name() const { return this->m_name; };
+        GLuint binding() const { return this->m_binding; };
+        GLuint bufferid() const { return this->m_ubo; };
+        GLsizeiptr size() const { return this->m_size; };
+
+        struct registered_t
+        {
+            GLuint binding;
+            GLsizeiptr size;
+        };
+        // block name -> binding point of every created block, consulted by prog_t after link
+        static std::unordered_map<std::string, registered_t> &registry();
+
+    private:
+        struct member_t
+        {
+            std::string name;
+            GLint offset = 0, size = 0, align = 0, stride = 0, count = 1;
+            GLint columns = 1, rows = 1;
+        };
+
+        const member_t *find(std::string_view member) const;
+        void mark_dirty(GLsizeiptr offset, GLsizeiptr len);
+
+        std::string m_name;
+        GLuint m_binding;
+        GLuint m_ubo = 0;
+        GLsizeiptr m_size = 0;
+        std::vector<member_t> m_members;
+        std::vector<unsigned char> m_data;
+        GLsizeiptr m_dirtyBegin = 0, m_dirtyEnd = 0;
+    };
+
+    // 顶点数据类型
+    enum class vertexType_t
+    {
+        POSITION_ENU,
+        NORMAL_ENU,
+        TEXCOORD_ENU,
+        TANGENT_ENU,
+        BITTANGENT_ENU
+    };
+
+    /**
+     * mesh_t在GPU上的顶点格式。缺省值就是原来的56字节全float布局(position/normal/texcoord/tangent/bitangent)。
+     * 属性位置约定不变(见model_t)，只是存储格式不同，glVertexAttribPointer取数时还原为float：
+     *   position  FLOAT3 | QUANT16: 包围盒内16bit量化，p = dequant_offset + dequant_scale * aPos(两个uniform由Draw设置)
+     *   normal    FLOAT3 | OCT16: 八面体编码的vec2 | INT_2_10_10_10: vec4，取.xyz | NONE
+     *   texcoord  FLOAT2 | HALF2 | UNORM16(只适用于[0,1]内的坐标) | NONE
+     *   tangent   FLOAT3: location 3/4 的tangent+bitangent | QTANGENT: location 3 的单个四元数，
+     *             包含完整的切线空间(含法线)，w的符号是bitangent的手性 | NONE
+     * HALF2/UNORM16/INT_2_10_10_10不需要修改shader；OCT16/QTANGENT/QUANT16需要在shader中解码，
+     * 可以 #include "myglutil/vertex_decode.glsl"(内容见glsl_decode()，配合defines()生成的宏)。
+     *
+     * usage example:
+     *   shaders::vertexFormat_t fmt;
+     *   fmt.normal = shaders::vertexFormat_t::normal_t::OCT16;
+     *   fmt.texcoord = shaders::vertexFormat_t::texcoord_t::HALF2;
+     *   model.vertexFormat = fmt;
+     *   model.loadModel(path);
+     *   variants.add_virtual_file("myglutil/vertex_decode.glsl", shaders::vertexFormat_t::glsl_decode());
+     *   auto prog = variants.getFromPath("scan.vert", "scan.frag", fmt.defines());
+     **/
+    struct vertexFormat_t
+    {
+        enum class position_t
+        {
+            FLOAT3,
+            QUANT16
+        };
+        enum class normal_t
+        {
+            FLOAT3,
+            OCT16,
+            INT_2_10_10_10,
+            NONE
+        };
+        enum class texcoord_t
+        {
+            FLOAT2,
+            HALF2,
+            UNORM16,
+            NONE
+        };
+        enum class tangent_t
+        {
+            FLOAT3,
+            QTANGENT,
+            NONE
+        };
+
+        position_t position = position_t::FLOAT3;
+        normal_t normal = normal_t::FLOAT3;
+        texcoord_t texcoord = texcoord_t::FLOAT2;
+        tangent_t tangent = tangent_t::FLOAT3;
+
+        struct attrib_t
+        {
+            GLuint location;
+            GLint size;
+            GLenum type;
+            GLboolean normalized;
+            GLsizei offset;
+        };
+        // attribute records in buffer order, every offset is 4-byte aligned
+        std::vector<attrib_t> attribs() const;
+        GLsizei stride() const;
+
+        // macros selecting the matching branches of glsl_decode()
+        std::vector<std::pair<std::string, std::string>> defines() const;
+        static const std::string &glsl_decode();
+    };
+
+    // 编译期顶点布局的属性标签，location与model_t中的约定一致
+    namespace attrib
+    {
+        struct position_t
+        {
+            static constexpr GLuint location = 0;
+            static constexpr GLint components = 3;
+        };
+        struct normal_t
+        {
+            static constexpr GLuint location = 1;
+            static constexpr GLint components = 3;
+        };
+        struct texcoord_t
+        {
+            static constexpr GLuint location = 2;
+            static constexpr GLint components = 2;
+        };
+        struct tangent_t
+        {
+            static constexpr GLuint location = 3;
+            static constexpr GLint components = 3;
+        };
+        struct bitangent_t
+        {
+            static constexpr GLuint location = 4;
+            static constexpr GLint components = 3;
+        };
+    };
+
+    /**
+     * 编译期确定的顶点布局：顶点只包含列出的属性(按列出的顺序交错存放，float分量)，
+     * 顶点大小、各属性偏移和glVertexAttribPointer参数都在编译期生成，未列出的属性不占内存也不会被取数。
+     *
+     * usage example:
+     *   using textured_t = shaders::vertexLayout_t<shaders::attrib::position_t, shaders::attrib::texcoord_t>;
+     *   static_assert(textured_t::stride == 5 * sizeof(GLfloat));
+     *   cubeModel.loadNativeData<textured_t>(cubeNative, {{aiTextureType_DIFFUSE, "marble.jpg"}});
+     **/
+    template <typename... A>
+    struct vertexLayout_t
+    {
+        static_assert(sizeof...(A) > 0, "empty vertex layout");
+
+        static constexpr GLint floats = (A::components + ...);
+        using vertex_t = std::array<GLfloat, floats>;
+        static constexpr GLsizei stride = sizeof(vertex_t);
+
+        template <typename X>
+        static constexpr bool has = (std::is_same_v<X, A> || ...);
+
+        template <typename X>
+        static constexpr GLsizei offset_of()
+        {
+            static_assert(has<X>, "attribute is not part of the layout");
+            GLsizei offset = 0;
+            bool found = false;
+            ((found = found || std::is_same_v<X, A>, offset += found ? 0 : A::components * sizeof(GLfloat)), ...);
+            return offset;
+        };
+
+        static constexpr std::array<vertexFormat_t::attrib_t, sizeof...(A)> attribs()
+        {
+            return {{{A::location, A::components, GL_FLOAT, GL_FALSE, offset_of<A>()}...}};
+        };
+
+    private:
+        static constexpr bool unique_locations()
+        {
+            GLuint locations[] = {A::location...};
+            for (std::size_t i = 0; i < sizeof...(A); i++)
+                for (std::size_t j = i + 1; j < sizeof...(A); j++)
+                    if (locations[i] == locations[j])
+                        return false;
+            return true;
+        };
+        static_assert(unique_locations(), "an attribute appears twice in the layout");
+    };
+
+    /**
+     * 进程内共享的工作线程池(hardware_concurrency - 1个线程)，用于加载时CPU密集的工作。任务中不能调用GL。
+     * parallel_for的调用线程也参与计算，因此在任务中嵌套调用不会死锁。
+     * usage example:
+     *   auto &pool = shaders::threadPool_t::instance();
+     *   pool.parallel_for(n, [&](std::size_t begin, std::size_t end) { for (auto i = begin; i < end; i++) ...; });
+     *   auto done = pool.submit([] { ... });
+     *   done.wait();
+     * uploadQueue_t::cancel()时暂停并重启工作线程；进程退出前由uploadQueue_t::shutdown()停止，之后submit/parallel_for在调用线程上直接执行。
+     **/
+    class threadPool_t
+    {
+    public:
+        static threadPool_t &instance();
+        ~threadPool_t();
+
+        std::size_t size() const { return this->m_workers.size(); };
+        std::future<void> submit(std::function<void()> task);
+        // drop the queued tasks and wait for the running ones, then start the workers again; the dropped tasks are destroyed
+        // on the caller. Not from a task of the pool
+        void cancel();
+        // as cancel, but the workers stay stopped: for the exit of the process
+        void shutdown();
+        // run body over [0, n) in ranges of at least grain items, return when all ranges are done.
+        // an exception from body skips the ranges not started yet and is rethrown here after the running ones finished
+        void parallel_for(std::size_t n, const std::function<void(std::size_t, std::size_t)> &body, std::size_t grain = 4096);
+
+    private:
+        threadPool_t();
+        void run();
+        void start();
+        void stop();
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::deque<std::function<void()>> m_tasks;
+        std::vector<std::thread> m_workers;
+        bool m_stop = false;
+        bool m_shutdown = false;
+    };
+
+    /**
+     * 渲染线程上的GL上传队列：工作线程准备好CPU数据后把上传任务排进来，渲染线程每帧(context为current时)
+     * 调用drain(budget)，在时间预算内执行尽可能多的任务，其余的留到之后的帧，避免一次上传阻塞整帧。
+     * 只要队列非空，每次drain至少执行一个任务，超过预算的单个任务也能完成。
+     * 任务可能持有GL对象(PBO、mesh缓冲)，销毁context之前须在context仍为current的渲染线程上调用cancel()：
+     * 暂停threadPool_t，丢弃剩余任务，GL对象在这里释放，之后队列和线程池照常可用；被取消的loadModelAsync
+     * 在下一次Draw时标记为failed。shutdown()用于进程退出，之后push返回false，任务直接丢弃。不依赖静态对象的析构顺序。
+     * usage example:
+     *   //每帧开始
+     *   shaders::uploadQueue_t::instance().drain(std::chrono::milliseconds(2));
+     *   //销毁context之前(例如GtkGLArea的unrealize)
+     *   shaders::uploadQueue_t::instance().cancel();
+     **/
+    class uploadQueue_t
+    {
+    public:
+        static uploadQueue_t &instance();
+        ~uploadQueue_t();
+
+        // thread-safe, task runs on the render thread inside drain; false after shutdown, the task is dropped
+        bool push(std::function<void()> task);
+        // run tasks until budget is spent, return the number of tasks run
+        std::size_t drain(std::chrono::steady_clock::duration budget);
+        std::size_t pending() const;
+        // on the render thread with the context current: pause the pool, then drop every task left. Both stay usable
+        void cancel();
+        // as cancel, for the exit of the process: the pool stops and the queue takes no more tasks
+        void shutdown();
+        bool closed() const;
+        // counts cancel and shutdown, work started before the last one was dropped
+        std::size_t generation() const { return this->m_generation; };
+
+    private:
+        uploadQueue_t() = default;
+        void drop(bool close);
+
+        mutable std::mutex m_mutex;
+        std::deque<std::function<void()>> m_tasks;
+        bool m_closed = false;
+        std::atomic<std::size_t> m_generation{0};
+    };
+
+    /**
+     * 导入时的网格优化，model_t对每个带索引的mesh自动执行(见model_t::meshOptimization)：
+     *   1. optimize_vertex_cache: Forsyth线性时间算法重排三角形，提高post-transform cache命中率
+     *   2. optimize_overdraw: 在1的结果中cache冷启动处切簇，朝外的簇排在前面以减少overdraw；ACMR变差超过threshold则放弃
+     *   3. optimize_vertex_fetch: 顶点按首次使用的顺序重排，顶点取数顺序访问内存，未被引用的顶点被丢弃
+     * ACMR: 每个三角形平均的顶点着色次数(0.5~3，越小越好)；ATVR: 顶点着色次数/被引用的顶点数(1最优)
+     * usage example:
+     *   auto stats = shaders::meshopt::analyze_vertex_cache(indices.data(), indices.size(), vertexCount);
+     *   shaders::meshopt::optimize_vertex_cache(indices.data(), indices.size(), vertexCount);
+     **/
+    namespace meshopt
+    {
+        struct cacheStats_t
+        {
+            float acmr = 0.0f;
+            float atvr = 0.0f;
+        };
+        struct report_t
+        {
+            cacheStats_t before, after;
+            std::size_t triangles = 0;
+            std::size_t vertices_dropped = 0; // not referenced by any index
+            bool overdraw = false;            // optimize_overdraw kept its order
+        };
+
+        // simulates a FIFO post-transform cache of cache_size entries
+        cacheStats_t analyze_vertex_cache(const GLuint *indices, std::size_t count, std::size_t vertex_count,
+                                          unsigned cache_size = 16);
+        void optimize_vertex_cache(GLuint *indices, std::size_t count, std::size_t vertex_count);
+        // the float3 position of vertex i is at (const unsigned char *)positions + i * position_stride
+        bool optimize_overdraw(GLuint *indices, std::size_t count, const GLfloat *positions, std::size_t position_stride,
+                               std::size_t vertex_count, float threshold = 1.05f);
+        // reorders the vertices (stride bytes each) in place and rewrites indices, returns the new vertex count
+        std::size_t optimize_vertex_fetch(void *vertices, std::size_t vertex_count, std::size_t stride,
+                                          GLuint *indices, std::size_t count);
+        // the three passes in order, a negative position_offset skips optimize_overdraw; vertex_count is updated
+        report_t optimize(void *vertices, std::size_t &vertex_count, std::size_t stride, std::ptrdiff_t position_offset,
+                          std::vector<GLuint> &indices);
+
+        struct weldReport_t
+        {
+            std::size_t input = 0, output = 0;
+            // share of the vertices removed, 0 when nothing was welded
+            float reduction() const { return input == 0 ? 0.0f : 1.0f - static_cast<float>(output) / static_cast<float>(input); };
+        };
+        /**
+         * 顶点焊接：只比较attribs中的GL_FLOAT属性，epsilon为0时要求完全相等，否则按epsilon的网格量化后相等即合并。
+         * unique得到去重后的顶点(保留首次出现的那个)，remap[i]是第i个输入顶点在unique中的下标，可直接作为索引。
+         * 顶点数较多时在threadPool_t上并行计算。
+         * usage example:
+         *   std::vector<unsigned char> unique;
+         *   std::vector<GLuint> indices;
+         *   auto r = shaders::meshopt::weld(data, count, stride, attribs, n, 0.0f, unique, indices);
+         **/
+        weldReport_t weld(const void *vertices, std::size_t vertex_count, std::size_t stride,
+                          const vertexFormat_t::attrib_t *attribs, std::size_t nattribs, float epsilon,
+                          std::vector<unsigned char> &unique, std::vector<GLuint> &remap);
+    };
+
+    // GPU上传后CPU端几何数据的保留策略
+    enum class residency_t
+    {
+        KEEP,      // keep vertices and indices
+        DROP,      // release both after upload
+        POSITIONS  // keep only mesh_t::positions and indices, e.g. for picking and culling
+    };
+
+    class mesh_t
+    {
+        
+    public:
+        struct vertex_t //= struct //__Vertex
+        {
+            // position
+            Eigen::Vector3f Position;
+            // normal
+            Eigen::Vector3f Normal;
+            // texCoords
+            Eigen::Vector2f TexCoords;
+            // tangent
+            Eigen::Vector3f Tangent;
+            // bitangent
+            Eigen::Vector3f Bitangent;
+        };
+
+        struct texture_t //= struct //__Texture
+        {
+            GLuint id;
+            std::string type;
+            std::string path;
+        };
+
+    public:
+        // mesh Data
+        std::vector<vertex_t> vertices;
+        std::vector<GLuint> indices;
+        std::vector<texture_t> textures;
+        // compact copy of the positions, only filled by residency_t::POSITIONS
+        std::vector<Eigen::Vector3f> positions;
+        glVertexArray_t VAO;
+        // constructor, the import buffers are moved in: pass them with std::move to avoid copies
+        mesh_t(std::vector<vertex_t> _vertices, std::vector<GLuint> _indices,
+               std::vector<texture_t> _textures, const vertexFormat_t &_format = {});
+        // upload already interleaved vertices described by attribs as they are (see vertexLayout_t), vertices stays empty
+        mesh_t(const void *_interleaved, std::size_t _count, GLsizei _stride,
+               const vertexFormat_t::attrib_t *_attribs, std::size_t _nattribs,
+               std::vector<GLuint> _indices, std::vector<texture_t> _textures);
+        // move-only, the GL objects are released with the mesh
+        mesh_t(const mesh_t &) = delete;
+        mesh_t &operator=(const mesh_t &) = delete;
+        mesh_t(mesh_t &&) = default;
+        mesh_t &operator=(mesh_t &&) = default;
+
+        // render the mesh
+        void Draw(shaders::prog_t &shader);
+
+        const vertexFormat_t &format() const { return this->m_format; };
+        // true when the vertices/indices live in a model_t arena (see model_t::build_arena)
+        bool in_arena() const { return this->m_arena >= 0; };
+        std::size_t vertex_count() const { return this->m_vertexCount; };
+        std::size_t index_count() const { return this->m_indexCount; };
+
+        // release CPU copies according to policy (the GPU buffers are not affected), return the bytes freed
+        std::size_t apply_residency(residency_t policy);
+        // total bytes released by apply_residency
+        std::size_t bytes_saved() const { return this->m_bytesSaved; };
+        // size of the vertex buffer on the GPU
+        GLsizeiptr vertex_bytes() const { return static_cast<GLsizeiptr>(this->m_vertexCount) * this->m_stride; };
+        // GL_UNSIGNED_SHORT whenever the mesh, or each of its chunks, addresses at most 65536 vertices
+        GLenum index_type() const { return this->m_indexType; };
+        GLsizeiptr index_bytes() const { return static_cast<GLsizeiptr>(this->m_indexCount) * index_size(this->m_indexType); };
+        // draw calls per submission, more than 1 when a large mesh is split for 16-bit indices
+        std::size_t chunk_count() const { return this->m_chunks.size(); };
+        // result of the import-time optimization, empty when it did not run
+        const meshopt::report_t &cache_report() const { return this->m_cacheReport; };
+        // result of the welding pass, empty when it did not run (see model_t::weldVertices)
+        const meshopt::weldReport_t &weld_report() const { return this->m_weldReport; };
+
+    private:
+        // render data
+        glBuffer_t VBO, EBO;
+        vertexFormat_t m_format;
+        std::vector<vertexFormat_t::attrib_t> m_attribs;
+        GLsizei m_stride = 0;
+        std::size_t m_vertexCount = 0, m_indexCount = 0;
+        std::size_t m_bytesSaved = 0;
+        meshopt::report_t m_cacheReport;
+        meshopt::weldReport_t m_weldReport;
+        // QUANT16 positions: p = m_dequantOffset + m_dequantScale * q
+        Eigen::Vector3f m_dequantScale = Eigen::Vector3f::Ones(), m_dequantOffset = Eigen::Vector3f::Zero();
+        // sampler uniform name of each texture ("texture_diffuse1" ...), built once at construction
+        std::vector<std::string> m_samplerNames;
+        // where the draw reads from: the own VAO, or the arena VAO with offsets into the shared buffers
+        GLuint m_drawVao = 0;
+        GLint m_baseVertex = 0;
+        GLsizeiptr m_firstIndex = 0; // byte offset into the element buffer
+        int m_arena = -1;
+        // index ranges drawn one call each, 16-bit indices are relative to the chunk's base vertex
+        struct chunk_t
+        {
+            GLsizei count;
+            GLsizeiptr firstIndex; // bytes, relative to m_firstIndex
+            GLint baseVertex;      // relative to m_baseVertex
+        };
+        std::vector<chunk_t> m_chunks;
+        GLenum m_indexType = GL_UNSIGNED_INT;
+        friend class model_t;
+
+        static GLsizeiptr index_size(GLenum type) { return type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint); };
+        // narrowest GPU encoding of indices, fills m_chunks and m_indexType
+        std::vector<unsigned char> encode_indices();
+
+        // build the sampler names of textures
+        void nameSamplers();
+        // bind the textures and set the per-mesh uniforms
+        void bind_material(shaders::prog_t &shader);
+        // issue the draw calls, the VAO must already be bound; return the number of calls
+        std::size_t submit();
+        std::size_t submit_instanced(GLsizei instances);
+        // filled field by field by model_t when restoring a cooked model or converting meshes on workers
+        mesh_t() = default;
+        // GPU-format copies of the vertices and indices, ready for upload()
+        struct staged_t
+        {
+            std::vector<unsigned char> vertices, indices;
+        };
+        // CPU half of the vertex_t constructor, touches no GL state and may run on a worker thread
+        staged_t stage(const vertexFormat_t &format);
+        // initializes all the buffer objects/arrays from interleaved vertices laid out as m_attribs
+        void setupMesh(const void *data, GLsizeiptr bytes);
+        // create the VAO/VBO/EBO from data already in GPU format (indices encoded as m_indexType)
+        void upload(const void *data, GLsizeiptr bytes, const void *indexData, GLsizeiptr indexBytes);
+        // convert vertices to m_format
+        std::vector<unsigned char> pack();
+    };
+
+    /**
+     * 可加载原始数据，或任何assimp支持的规范化模型数据。
+     * 加载的顶点数据属性位置，固定为以下属性位置。因此在书写GLSL时填写属性位置，或在其他地方指定属性位置时必须按照
+     * 下面的属性位置约定进行编码，该约定固定编码在mesh_t.setupMesh()中： 
+     *        0: vertex positon;        1:vertex normals; 
+     *        2: vextex texture coords; 3: vertex tangent
+     *        4: vertex bitangent
+     *        5..8: 实例的model矩阵(mat4，每列一个location)； 9: 实例颜色vec4。 仅DrawInstanced使用
+     * 同时约定：上述这些顶点数据，除了`texture coords是vec2外，其他顶点数据都是vec3
+     * 顶点在GPU上的存储格式由vertexFormat决定(见vertexFormat_t)，需在loadModel/loadNativeData之前设置。
+    */
+    class modelStream_t;
+    class model_t
+    {
+        struct boneInfo_t //= struct __BoneInfo
+        {
+            /*
+        	For uniquely indentifying the bone and
+		    for indexing bone transformation in shaders
+            */
+            int id;
+            /*
+		    map from bone name to offset matrix.
+		    offset matrix transforms bone from bone space to local space
+	        */
+            Eigen::Matrix4f offset;
+        };
+
+    public:
+        // model data
+        std::vector<mesh_t::texture_t> textures_loaded; // stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+        std::vector<mesh_t> meshes;
+        std::string directory;
+        bool gammaCorrection; // the diffuse textures are sRGB, sampled back to linear
+        // GPU vertex format of the meshes loaded afterwards
+        vertexFormat_t vertexFormat;
+        // what the meshes loaded afterwards keep on the CPU after upload
+        residency_t residency = residency_t::KEEP;
+        // run meshopt::optimize on the indexed meshes loaded afterwards
+        bool meshOptimization = true;
+        // opt-in for loadNativeData: weld equal vertices (within weldEpsilon, see meshopt::weld) and draw them indexed
+        bool weldVertices = false;
+        float weldEpsilon = 0.0f;
+
+        // constructor, expects a filepath to a 3D model.
+        model_t(bool gamma = false) : gammaCorrection(gamma){};
+        // move-only, owns the GL objects of its meshes and textures
+        model_t(const model_t &) = delete;
+        model_t &operator=(const model_t &) = delete;
+        model_t(model_t &&) = default;
+        model_t &operator=(model_t &&) = default;
+
+        // draws the model, and thus all its meshes
+        // the meshes of an arena are drawn together, then the meshes outside any arena in their order
+        void Draw(shaders::prog_t &shader);
+
+        /**
+         * 把还没有进入arena的mesh按顶点布局合并：每种布局一组共享的VBO/EBO/VAO，mesh的数据用glCopyBufferSubData
+         * 在GPU上拷贝过去(不需要CPU副本，residency_t::DROP之后也可以调用)，mesh自己的VAO/VBO/EBO随即释放。
+         * 之后Draw对每个arena只绑定一次VAO，mesh用glDrawElementsBaseVertex加偏移绘制。返回新建arena的数量。
+         * packArenas为true时loadModel/loadModelAsync直接把数据上传进arena，不需要再调用build_arena。
+         *
+         * usage example:
+         *   model.loadNativeData<textured_t>(cubeNative);
+         *   model.loadNativeData<textured_t>(planeNative);
+         *   model.build_arena();
+         *   model.Draw(prog);
+         **/
+        std::size_t build_arena();
+        std::size_t arena_count() const { return this->m_arenas.size(); };
+        // loadModel/loadModelAsync upload the meshes they load straight into new arenas instead of buffers of their own
+        bool packArenas = true;
+
+        /**
+         * 硬件实例化：一次绘制count个副本，model矩阵(和可选的颜色)作为实例属性(divisor 1)流式上传，
+         * 不使用`model` uniform。未提供颜色时实例颜色为(1,1,1,1)。属性位置见上面的约定。
+         * usage example:
+         *   // GLSL: layout (location = 5) in mat4 aInstanceModel; layout (location = 9) in vec4 aInstanceColor;
+         *   std::vector<Eigen::Matrix4f> transforms{a.matrix(), b.matrix()};
+         *   cubeModel.DrawInstanced(instancedProg, transforms);
+         **/
+        static constexpr GLuint instanceModelLocation = 5, instanceColorLocation = 9;
+        void DrawInstanced(shaders::prog_t &shader, const Eigen::Matrix4f *transforms, std::size_t count,
+                           const Eigen::Vector4f *colors = nullptr);
+        void DrawInstanced(shaders::prog_t &shader, const std::vector<Eigen::Matrix4f> &transforms,
+                           const std::vector<Eigen::Vector4f> &colors = {})
+        {
+            this->DrawInstanced(shader, transforms.data(), transforms.size(),
+                                colors.size() >= transforms.size() ? colors.data() : nullptr);
+        };
+
+        // 支持GL 4.3 / ARB_multi_draw_indirect时，arena中的mesh按纹理组分组，每组一次glMultiDrawElementsIndirect。
+        // 间接命令缓冲只在arena的mesh集合变化(build_arena)后的第一次Draw中生成
+        bool multiDraw = true;
+        // draw calls issued by the last Draw
+        std::size_t draw_calls() const { return this->m_drawCalls; };
+
+        // CPU memory released by the residency policy over all meshes
+        std::size_t bytes_saved() const;
+        // ACMR/ATVR before and after meshopt::optimize over all meshes, weighted by triangles
+        meshopt::report_t cache_report() const;
+        // vertices before and after welding over all meshes
+        meshopt::weldReport_t weld_report() const;
+
+        auto &GetOffsetMatMap() { return m_OffsetMatMap; }
+        int &GetBoneCount() { return m_BoneCount; }
+
+        /**
+         * 烘焙模型缓存：loadModel第一次用assimp导入后，把GPU格式的顶点/索引缓冲、纹理引用和骨骼表写入
+         * cache_root()/models/<key>.glmodel，之后直接mmap该文件并把缓冲原样交给GL，不再经过assimp。
+         * key = hash(模型绝对路径, 文件大小, 修改时间, vertexFormat, meshOptimization)，模型文件变化后自动重新导入。
+         * 从缓存加载的mesh没有vertices(vertex_t)，residency不是DROP时恢复indices和float3的positions。
+         * usage example:
+         *   model.loadModel("backpack.obj");   // 第一次：assimp导入并写缓存
+         *   model.loadModel("backpack.obj");   // 之后：loaded_cooked() == true
+         **/
+        bool cooked = true;
+        bool loaded_cooked() const { return this->m_loadedCooked; };
+
+        // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+        void loadModel(const std::filesystem::path &path);
+
+        /**
+         * 异步加载，立即返回：assimp导入和mesh转换在threadPool_t上执行，每个mesh的缓冲按uploadSliceBytes切成
+         * 多个glBufferSubData任务排进uploadQueue_t，由渲染线程drain时按时间预算执行，大mesh也不会占满一帧。上传好的mesh在之后的Draw/DrawInstanced中加入meshes，
+         * 全部完成后纹理和骨骼表并入模型。packArenas时mesh直接上传进这次加载的arena，加载完成后arena并入模型，
+         * 之后Draw按arena(multi-draw)绘制。不读写烘焙模型缓存。model_t销毁后剩余的任务自动跳过。
+         * usage example:
+         *   auto stream = model.loadModelAsync("sponza.obj");
+         *   //每帧
+         *   shaders::uploadQueue_t::instance().drain(std::chrono::milliseconds(2));
+         *   model.Draw(prog);   // 已经到达的mesh
+         *   if (stream->done()) ...
+         **/
+        std::shared_ptr<modelStream_t> loadModelAsync(const std::filesystem::path &path);
+        // the most bytes one upload job of loadModelAsync writes into a buffer
+        GLsizeiptr uploadSliceBytes = GLsizeiptr(1) << 20;
+        // some loadModelAsync has meshes or textures not handed over yet
+        bool streaming() const { return this->m_streams.empty() == false; };
+        /**
         * 加载, 绑定原始vbo数据到model。
         * cols: vertices 每行代表一个vertex.列数由cols传递
         *                一个vertex可能包含一个或多个vertex attrib
@@ -275,660 +1643,4241 @@ namespace shaders
         * */
         using vertexAttrib_t = std::initializer_list<std::tuple<vertexType_t /*顶点数据类型*/,
                                                                 long /*该顶点数据在一行中的起始位置*/>>;
+        using nativeTextures_t = std::initializer_list<std::tuple<aiTextureType /*纹理类型*/,
+                                                                  std::string /*纹理图片路径*/>>;
         bool loadNativeData(int cols,
                             vertexAttrib_t howto_do,
                             const std::vector<GLfloat> &vertexNative,
-                            std::initializer_list<std::tuple<aiTextureType /*纹理类型*/,
-                                                             std::string /*纹理图片路径*/>>
-                                _texturesNative = {},
+                            nativeTextures_t _texturesNative = {},
                             const std::vector<GLuint> &_indices = std::vector<GLuint>{});
 
-    private:
-        std::unordered_map<std::string, boneInfo_t> m_OffsetMatMap;
-        int m_BoneCount = 0;
+        /**
+         * 按编译期布局L加载原始顶点数据：每行依次是L中列出的属性，不做任何转换直接上传，
+         * 只启用L中的属性(vertexFormat不参与)。
+         * usage example:
+         *   using textured_t = shaders::vertexLayout_t<shaders::attrib::position_t, shaders::attrib::texcoord_t>;
+         *   cubeModel.loadNativeData<textured_t>(cubeNative, {{aiTextureType_DIFFUSE, "marble.jpg"}});
+         **/
+        template <typename L>
+        bool loadNativeData(const std::vector<GLfloat> &vertexNative,
+                            nativeTextures_t _texturesNative = {},
+                            const std::vector<GLuint> &_indices = std::vector<GLuint>{})
+        {
+            if (vertexNative.size() % L::floats != 0)
+            {
+                std::cout << "vertex data is not a whole number of layout vertices when calling " << __func__ << std::endl;
+                return false;
+            }
+            static constexpr auto attribs = L::attribs();
+            return this->loadLayoutData(vertexNative.data(), vertexNative.size() / L::floats, L::stride,
+                                        attribs.data(), attribs.size(), _texturesNative, _indices);
+        };
+        template <typename L>
+        bool loadNativeData(const std::vector<typename L::vertex_t> &vertices,
+                            nativeTextures_t _texturesNative = {},
+                            const std::vector<GLuint> &_indices = std::vector<GLuint>{})
+        {
+            static constexpr auto attribs = L::attribs();
+            return this->loadLayoutData(vertices.data(), vertices.size(), L::stride,
+                                        attribs.data(), attribs.size(), _texturesNative, _indices);
+        };
+
+    private:
+        std::unordered_map<std::string, boneInfo_t> m_OffsetMatMap;
+        int m_BoneCount = 0;
+        // bone ids by name, shared with the scratch models of loadModelAsync: ids are taken under the lock,
+        // so concurrent loads into one model never hand out the same id twice
+        struct boneIds_t
+        {
+            std::mutex mutex;
+            std::unordered_map<std::string, int> ids;
+            int count = 0;
+        };
+        std::shared_ptr<boneIds_t> m_boneIds = std::make_shared<boneIds_t>();
+        // the id of the bone called name, a new one the first time
+        int bone_id(const std::string &name);
+        // every texture used by the meshes, by id; mesh_t::texture_t only refers to them
+        std::unordered_map<GLuint, textureRegistry_t::handle_t> m_textures;
+        bool m_loadedCooked = false;
+        std::vector<std::shared_ptr<modelStream_t>> m_streams;
+
+        // move the meshes uploaded by loadModelAsync into meshes, and the rest of a finished load
+        void adoptStreams();
+        constexpr static unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace |
+                                                    aiProcess_JoinIdenticalVertices;
+
+        // layout of the cooked model file, see cooked
+        struct cookedHeader_t
+        {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t meshes;
+            std::uint64_t key;
+            std::uint32_t bones;
+            std::int32_t boneCount;
+        };
+        struct cookedMesh_t
+        {
+            std::uint32_t vertexCount, indexCount, stride, indexType;
+            std::uint32_t attribs, chunks, textures, overdraw;
+            std::uint32_t format[4]; // vertexFormat_t position, normal, texcoord, tangent
+            float dequantScale[3], dequantOffset[3];
+            float cacheStats[4]; // ACMR/ATVR before, ACMR/ATVR after
+            std::uint64_t triangles, verticesDropped;
+            std::uint64_t vertexBytes, indexBytes;
+        };
+        constexpr static std::uint32_t COOKED_VERSION = 1;
+        std::uint64_t cooked_key(const std::filesystem::path &path) const;
+        std::filesystem::path cooked_file(std::uint64_t key) const;
+        // restore the meshes from the cooked file, false when it is missing, stale or corrupt
+        bool loadCooked(const std::filesystem::path &path);
+        // write the meshes from first on, read back from their GPU buffers, with the bones of the import they came from
+        bool writeCooked(const std::filesystem::path &path, std::size_t first, const std::vector<std::string> &bones);
+
+        // GPU-format data of one mesh, as given to mesh_t::upload
+        struct meshData_t
+        {
+            const void *vertices, *indices;
+        };
+        // group the meshes from first on that are not in an arena yet into new arenas, return the number created.
+        // with data (one entry per mesh from first on) the bytes are uploaded into the arena, otherwise the meshes' own buffers are copied
+        std::size_t pack_arenas(std::size_t first, const std::vector<meshData_t> &data);
+
+        // one shared buffer pair and VAO per vertex layout
+        struct arena_t
+        {
+            glVertexArray_t vao;
+            glBuffer_t vbo, ebo;
+            GLsizei stride = 0;
+            GLenum indexType = GL_UNSIGNED_INT;
+            std::vector<vertexFormat_t::attrib_t> attribs;
+            std::vector<std::size_t> meshes; // indices into meshes
+
+            // multi-draw indirect: one batch per texture set, commands prebuilt in indirect
+            struct batch_t
+            {
+                std::size_t mesh; // supplies the textures and per-mesh uniforms of the batch
+                GLintptr offset;  // into indirect
+                GLsizei count;
+                bool indexed;
+            };
+            glBuffer_t indirect;
+            std::vector<batch_t> batches;
+            bool commandsDirty = true;
+            // bytes placed so far, the sizes of vbo/ebo once created
+            GLsizeiptr vertexBytes = 0, indexBytes = 0;
+        };
+        std::vector<arena_t> m_arenas;
+        // give m its range in the first arena from firstArena on with its layout (appended if there is none), no GL
+        static void place_arena(std::vector<arena_t> &arenas, std::size_t firstArena, mesh_t &m);
+        // buffers at their full size and the VAO of an arena whose meshes are placed
+        static void create_arena(arena_t &a);
+        // write the data of a placed mesh into its range, or copy it from the mesh's own buffers when data is empty
+        static void fill_arena(const arena_t &a, mesh_t &m, const meshData_t &data);
+        std::size_t m_drawCalls = 0;
+
+        // per-instance streams of DrawInstanced
+        glBuffer_t m_instanceMatrices, m_instanceColors;
+        std::size_t m_instanceCapacity = 0;
+        // point the instance attributes of the bound VAO at the instance streams
+        void bind_instance_attribs(bool colors);
+
+        static bool multidraw_supported();
+        void build_commands(arena_t &a);
+
+        // textures of one mesh as (file, sampler type), read from its material
+        using textureRefs_t = std::vector<std::pair<std::string, std::string>>;
+        // phase 1 of an import, no GL objects yet: meshes in the order of the recursive walk (node meshes first, then the children)
+        struct converted_t
+        {
+            std::vector<mesh_t> meshes;
+            std::vector<mesh_t::staged_t> staged;
+            std::vector<textureRefs_t> textures;
+            std::vector<std::string> bones; // used by the meshes, in the order they are met
+        };
+        // import in two phases: every mesh under node is converted on the worker pool, then uploaded here in order.
+        // returns the bones the meshes use
+        std::vector<std::string> processNode(aiNode *node, const aiScene *scene);
+        // phase 1, no GL: registers the bones and converts the meshes in parallel, scene may be released afterwards
+        void convertNode(aiNode *node, const aiScene *scene, converted_t &out);
+        // the textures of one loadModelAsync, only touched on the GL thread once the import is done
+        struct streamTextures_t
+        {
+            std::deque<std::shared_ptr<textureRegistry_t::batch_t>> waiting;    // not mapped yet
+            std::size_t mapped = 0;                                             // staging bytes of the batches in flight
+            std::unordered_map<std::string, std::vector<std::size_t>> waiters; // the meshes waiting for a texture, by key
+            std::vector<std::size_t> missing;                                   // textures each mesh still waits for
+            std::function<void(std::size_t)> upload;                            // queues the upload of mesh i
+        };
+        // GL thread: map waiting batches while they fit in textureRegistry_t::stagingBytes, each is decoded on the pool and
+        // finished by a GL job, which queues the meshes it completes and maps the next batches
+        static void stream_textures(const std::weak_ptr<modelStream_t> &weak, const std::shared_ptr<streamTextures_t> &state);
+        // uploadQueue_t::push for a job of the stream, which ends as failed once the queue is shut down
+        static bool stream_push(const std::weak_ptr<modelStream_t> &weak, std::function<void()> task);
+        // phase 2 for mesh i on the GL thread: textures and buffers, appended to meshes.
+        // without upload the buffers are left to pack_arenas and c.staged[i] is kept
+        void uploadConverted(converted_t &c, std::size_t i, bool upload = true);
+
+        void SetVertexBoneDataToDefault(mesh_t::vertex_t &vertex);
+
+        // CPU conversion of one aiMesh into out, runs on a worker thread: no GL, and m_OffsetMatMap is only read
+        void processMesh(aiMesh *mesh, const aiScene *scene, mesh_t &out, mesh_t::staged_t &staged);
+        // give ids to the bones of mesh not seen yet, called in import order before processMesh
+        void registerBones(aiMesh *mesh);
+        // the textures of a material in sampler order, no GL
+        textureRefs_t materialTextureRefs(aiMaterial *material);
+
+        void SetVertexBoneData(mesh_t::vertex_t &vertex, int boneID, float weight);
+
+        void ExtractBoneWeightForVertices(std::vector<mesh_t::vertex_t> &vertices,
+                                          aiMesh *mesh, const aiScene *scene);
+        // meshopt::optimize on import data when meshOptimization is set, unused vertices are erased
+        meshopt::report_t optimize_mesh(std::vector<mesh_t::vertex_t> &vertices, std::vector<GLuint> &indices);
+        // meshopt::weld when weldVertices is set: rows receives the unique vertices, indices are created or remapped
+        meshopt::weldReport_t weld_mesh(const void *vertices, std::size_t count, std::size_t stride,
+                                        const vertexFormat_t::attrib_t *attribs, std::size_t nattribs,
+                                        std::vector<unsigned char> &rows, std::vector<GLuint> &indices);
+
+        bool loadLayoutData(const void *interleaved, std::size_t count, GLsizei stride,
+                            const vertexFormat_t::attrib_t *attribs, std::size_t nattribs,
+                            nativeTextures_t _texturesNative, const std::vector<GLuint> &_indices);
+        std::vector<mesh_t::texture_t> loadNativeTextures(nativeTextures_t _texturesNative);
+
+        // the shared texture of directory/filename from textureRegistry_t, kept alive by the model
+        unsigned int TextureFromFile(const std::string &filename,
+                                     const std::string &directory, bool gamma = false);
+        // load the files under directory as one textureRegistry_t batch, decoded in parallel; materialTexture then finds them
+        std::vector<textureRegistry_t::handle_t> prefetchTextures(const textureRefs_t &refs);
+        // with gammaCorrection the color textures are sRGB, normal/specular/height maps hold data and stay linear
+        bool srgb(const std::string &typeName) const { return this->gammaCorrection && typeName == "texture_diffuse"; };
+        // appends the material textures of a given type to refs
+        void materialTextures(aiMaterial *mat, aiTextureType type, const std::string &typeName, textureRefs_t &refs);
+        // the texture of file (relative to directory), loaded once per model
+        mesh_t::texture_t materialTexture(const std::string &file, const std::string &typeName);
+    };
+
+    /**
+     * model_t::loadModelAsync的进度，可在任意线程查询。
+     * usage example:
+     *   auto stream = model.loadModelAsync(path);
+     *   std::cout << stream->meshes_uploaded() << "/" << stream->meshes_total() << std::endl;
+     **/
+    class modelStream_t
+    {
+    public:
+        // every mesh is uploaded, or the import failed
+        bool done() const { return this->m_done; };
+        bool failed() const { return this->m_failed; };
+        // 0 until the import on the worker finished
+        std::size_t meshes_total() const { return this->m_total; };
+        std::size_t meshes_uploaded() const { return this->m_uploaded; };
+        float progress() const
+        {
+            std::size_t total = this->m_total;
+            return total == 0 ? (this->m_done ? 1.0f : 0.0f) : static_cast<float>(this->m_uploaded) / total;
+        };
+
+    private:
+        friend class model_t;
+        // imports with the settings of the target model, what it creates moves over from here
+        model_t m_scratch;
+        std::vector<mesh_t> m_ready; // uploaded, not handed to the target yet
+        // meshes handed over whose data lives in an arena of m_scratch: (index in the target, arena), the arenas move over at the end
+        std::vector<std::pair<std::size_t, int>> m_placed;
+        // textures decoded ahead of the meshes, held until the meshes take their own references
+        std::vector<textureRegistry_t::handle_t> m_prefetched;
+        std::atomic<bool> m_done{false}, m_failed{false};
+        std::atomic<std::size_t> m_total{0}, m_uploaded{0};
+        std::size_t m_generation = 0; // of uploadQueue_t at the start, a cancel since then dropped jobs of this load
+    };
+
+};
+
+namespace trans
+{
+    // 通过反射关系，从入射/发现求出反射向量
+    // lightdir : 入射向量， 必须是单位向量, 光源 ->反射点
+    // normal :  法线 。  必须是单位向量
+    // 结果：  反射向量
+    Eigen::Vector3f reflect(Eigen::Vector3f lightdir, Eigen::Vector3f normal);
+    // eigen 实现 右手系范围是[-1,1] glm:: perspective 函数，"返回结果.data()" 作为传递uniform的参数
+    // 例子: auto projection = trans::perspective<GLfloat>(...);
+    //       glUniformMatrix4fv(glGetUniformLocation(prog, "projection"), 1, GL_FALSE, projection.data());
+    //
+    // fovy : Field of View,视野，通常设置为45度
+    // aspect： 视口宽高比
+    // near : 就是投影面，其值是投影面距离视点的距离，
+    // far  : 是视景体的后截面，其值是后截面距离视点的距离。far 和 near 的差值，就是视景体的深度。
+    Eigen::Matrix<GLfloat, 4, 4> perspective(GLfloat fovy, GLfloat aspectRatio, GLfloat zNear, GLfloat zFar);
+    //正交变换
+    Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor> ortho(GLfloat left,
+                                                        GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar);
+
+};
+
+namespace cv
+{
+    // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
+    enum class Camera_Movement
+    {
+        FORWARD,
+        BACKWARD,
+        LEFT,
+        RIGHT
+    };
+
+    // eye: 在世界坐标中摄像机位置. 眼睛在哪儿
+    // center: 在世界坐标中场景原点. 、看哪儿
+    // up:  在世界坐标中上向量(Up Vector). 头顶朝哪儿
+    //
+    // eigen 实现 glm:: lookAt 函数，"返回结果.data()" 作为传递uniform的参数
+    // 例子: auto view_eigen=trans::lookAt( Eigen::Vector3f(camX, 0.0f, camZ),... );
+    //       glUniformMatrix4fv(glGetUniformLocation(prog, "view"), 1, GL_FALSE,  view_eigen.data());
+    Eigen::Matrix<GLfloat, 4, 4> lookAt(const Eigen::Vector3f &eye,
+                                        const Eigen::Vector3f &center, const Eigen::Vector3f &up);
+
+    // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
+    class camera_t
+    {
+        constexpr static GLfloat YAW = -90.0f;
+        constexpr static GLfloat PITCH = 0.0f;
+        constexpr static GLfloat SPEED = 5.5f;
+        constexpr static GLfloat SENSITIVITY = 0.1f;
+        constexpr static GLfloat ZOOM = 45.0f;
+
+    public:
+        // camera Attributes
+        Eigen::Vector3f Position;
+        Eigen::Vector3f Front;
+        Eigen::Vector3f Up;
+        Eigen::Vector3f Right;
+        Eigen::Vector3f WorldUp;
+        // euler Angles
+        GLfloat Yaw, Pitch; // 是角度值，非弧度值
+        // camera options
+        GLfloat MovementSpeed = SPEED;
+        GLfloat MouseSensitivity = SENSITIVITY;
+        GLfloat Zoom = ZOOM;
+
+        // constructor with vectors
+        camera_t(Eigen::Vector3f position = Eigen::Vector3f(0.0f, 0.0f, 0.0f),
+                 Eigen::Vector3f up = Eigen::Vector3f(0.0f, 1.0f, 0.0f),
+                 GLfloat yaw = YAW, GLfloat pitch = PITCH);
+
+        // returns the view matrix calculated using Euler Angles and the LookAt Matrix
+        Eigen::Matrix<GLfloat, 4, 4> GetViewMatrix();
+
+        // processes input received from any keyboard-like input system. Accepts input parameter in the form
+        // of camera defined ENUM (to abstract it from windowing systems)
+        void ProcessKeyboard(Camera_Movement direction, GLfloat deltaTime);
+
+        // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
+        void ProcessMouseMovement(GLfloat xoffset, GLfloat yoffset, GLboolean constrainPitch = true);
+
+        // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
+        void ProcessMouseScroll(GLfloat yoffset);
+
+    private:
+        // calculates the front vector from the Camera's (updated) Euler Angles
+        void updateCameraVectors();
+    };
+
+};
+
+namespace assimp_helper
+{
+    static inline Eigen::Matrix4f ConvertAiMatrixToEigenFormat(const aiMatrix4x4 &from)
+    {
+        Eigen::Matrix4f to;
+        //the a,b,c,d in assimp is the row ; the 1,2,3,4 is the column
+        to << from.a1, from.a2, from.a3, from.a4,
+            from.b1, from.b2, from.b3, from.b4,
+            from.c1, from.c2, from.c3, from.c4,
+            from.d1, from.d2, from.d3, from.d4;
+        return to;
+    }
+
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+#if defined(MYGLUTILITY__IMPLEMENTATION) 
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Eigen::MatrixXd
+namespace shaders
+{
+    std::filesystem::path cache_root()
+    {
+        if (auto env = std::getenv("MYGLUTIL_CACHE_DIR"); env != nullptr && env[0] != '\0')
+            return std::filesystem::path(env);
+
+        std::error_code ec;
+        auto tmp = std::filesystem::temp_directory_path(ec);
+        if (ec)
+            tmp = std::filesystem::current_path();
+        return tmp / "myglutil_cache";
+    };
+
+    std::filesystem::path content_root()
+    {
+        if (auto env = std::getenv("MYGLUTIL_CONTENT_ROOT"); env != nullptr && env[0] != '\0')
+            return std::filesystem::path(env);
+
+        std::error_code ec;
+        auto cwd = std::filesystem::current_path(ec);
+        return ec ? std::filesystem::path() : cwd;
+    };
+
+    std::uint64_t fnv1a(const void *data, std::size_t len, std::uint64_t seed)
+    {
+        auto p = static_cast<const unsigned char *>(data);
+        std::uint64_t h = seed;
+        for (std::size_t i = 0; i < len; i++)
+        {
+            h ^= p[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    };
+
+    bool mappedFile_t::open(const std::filesystem::path &path)
+    {
+        this->close();
+#if defined(__linux__)
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void *p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                this->m_data = static_cast<const unsigned char *>(p);
+                this->m_size = static_cast<std::size_t>(st.st_size);
+                this->m_mapped = true;
+            }
+        }
+        ::close(fd);
+        return this->valid();
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (file.fail())
+            return false;
+        this->m_copy.resize(static_cast<std::size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(this->m_copy.data()), this->m_copy.size());
+        if (file.fail() || this->m_copy.empty())
+        {
+            this->m_copy.clear();
+            return false;
+        }
+        this->m_data = this->m_copy.data();
+        this->m_size = this->m_copy.size();
+        return true;
+#endif
+    };
+
+    void mappedFile_t::close()
+    {
+#if defined(__linux__)
+        if (this->m_mapped)
+            ::munmap(const_cast<unsigned char *>(this->m_data), this->m_size);
+#endif
+        this->m_copy.clear();
+        this->m_data = nullptr;
+        this->m_size = 0;
+        this->m_mapped = false;
+    };
+
+    binaryCache_t &binaryCache_t::instance()
+    {
+        static binaryCache_t cache;
+        return cache;
+    };
+
+    binaryCache_t::binaryCache_t() : m_dir(cache_root() / "programs"){};
+
+    bool binaryCache_t::enabled()
+    {
+        if (this->m_enabled == false)
+            return false;
+        if (this->m_formats < 0)
+        {
+            // GL_NUM_PROGRAM_BINARY_FORMATS is unknown before GL 4.1 / ARB_get_program_binary, only ask when it exists
+            // so that no GL_INVALID_ENUM is raised (and none of the caller's errors has to be cleared)
+            GLint major = 0, minor = 0, n = 0;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            if (major > 4 || (major == 4 && minor >= 1) || has_extension("GL_ARB_get_program_binary"))
+                glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+            this->m_formats = n;
+        }
+        return this->m_formats > 0;
+    };
+
+    std::uint64_t binaryCache_t::key(const std::string &vert_content, const std::string &frag_content) const
+    {
+        auto glstr = [](GLenum name) -> std::string
+        {
+            auto s = reinterpret_cast<const char *>(glGetString(name));
+            return s == nullptr ? std::string() : std::string(s);
+        };
+        // '\0' separators so that moving text from one field to the next changes the key
+        auto h = fnv1a(vert_content);
+        h = fnv1a("", 1, h);
+        h = fnv1a(frag_content, h);
+        for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            h = fnv1a("", 1, h);
+            h = fnv1a(glstr(name), h);
+        }
+        return h;
+    };
+
+    std::filesystem::path binaryCache_t::file_of(std::uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.glprog", static_cast<unsigned long long>(key));
+        return this->m_dir / name;
+    };
+
+    GLuint binaryCache_t::load(const std::string &vert_content, const std::string &frag_content)
+    {
+        if (this->enabled() == false)
+            return 0;
+
+        auto k = this->key(vert_content, frag_content);
+        auto path = this->file_of(k);
+        std::ifstream file(path, std::ios::binary);
+        if (file.fail())
+        {
+            this->m_misses++;
+            return 0;
+        }
+
+        header_t hdr;
+        std::vector<char> blob;
+        file.read(reinterpret_cast<char *>(&hdr), sizeof(hdr));
+        if (file.good() && std::memcmp(hdr.magic, "MGLPBIN", 8) == 0 &&
+            hdr.version == VERSION && hdr.key == k && hdr.length > 0)
+        {
+            blob.resize(hdr.length);
+            file.read(blob.data(), blob.size());
+            if (file.gcount() != static_cast<std::streamsize>(blob.size()))
+                blob.clear();
+        }
+        file.close();
+
+        GLuint prog = 0;
+        if (blob.empty() == false)
+        {
+            prog = glCreateProgram();
+            glProgramBinary(prog, hdr.format, blob.data(), static_cast<GLsizei>(blob.size()));
+            GLint linked = GL_FALSE;
+            glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+            if (linked == GL_FALSE)
+            {
+                glDeleteProgram(prog);
+                prog = 0;
+            }
+        }
+        if (prog == 0)
+        {
+            // stale or corrupt entry, drop it so that the next store rewrites it
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+            this->m_rejects++;
+            this->m_misses++;
+            return 0;
+        }
+
+        this->m_hits++;
+        return prog;
+    };
+
+    bool binaryCache_t::store(GLuint prog, const std::string &vert_content, const std::string &frag_content)
+    {
+        if (prog == 0 || this->enabled() == false)
+            return false;
+
+        GLint len = 0;
+        glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+        if (len <= 0)
+            return false;
+
+        header_t hdr;
+        std::memcpy(hdr.magic, "MGLPBIN", 8);
+        hdr.version = VERSION;
+        hdr.key = this->key(vert_content, frag_content);
+
+        std::vector<char> blob(len);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(prog, len, &written, &format, blob.data());
+        if (written <= 0)
+            return false;
+        hdr.format = format;
+        hdr.length = static_cast<std::uint64_t>(written);
+
+        std::error_code ec;
+        std::filesystem::create_directories(this->m_dir, ec);
+        // write to a temporary name first, concurrent processes must never see a half written binary
+        auto path = this->file_of(hdr.key);
+        auto tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            if (file.fail())
+                return false;
+            file.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+            file.write(blob.data(), written);
+            if (file.fail())
+                return false;
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+
+        this->m_stores++;
+        return true;
+    };
+
+    bool prog_t::use()
+    {
+        if (this->progid == 0)
+            return false;
+
+        glUseProgram(this->progid);
+        return true;
+    };
+
+    prog_t::~prog_t()
+    {
+        this->release();
+    };
+
+    prog_t::prog_t(prog_t &&other) noexcept
+    {
+        *this = std::move(other);
+    };
+
+    prog_t &prog_t::operator=(prog_t &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        this->release();
+
+        // the watcher keeps raw pointers, re-register under the new address
+        bool watched = other.m_watched.empty() == false;
+        if (watched)
+            shaderWatcher_t::instance().unwatch(&other);
+
+        this->progid = std::exchange(other.progid, 0);
+        this->m_separable = other.m_separable;
+        this->m_watched = std::move(other.m_watched);
+        this->m_rebuild = std::move(other.m_rebuild);
+        other.m_watched.clear();
+        other.m_rebuild = nullptr;
+        this->m_reload.prog = std::exchange(other.m_reload.prog, 0);
+        this->m_reload.vert = std::move(other.m_reload.vert);
+        this->m_reload.frag = std::move(other.m_reload.frag);
+        this->m_uniforms = std::move(other.m_uniforms);
+        this->m_shadow = std::move(other.m_shadow);
+        this->m_uploadsIssued = other.m_uploadsIssued;
+        this->m_uploadsSkipped = other.m_uploadsSkipped;
+
+        if (watched)
+            shaderWatcher_t::instance().watch(this);
+        return *this;
+    };
+
+    void prog_t::release()
+    {
+        if (this->m_watched.empty() == false)
+        {
+            shaderWatcher_t::instance().unwatch(this);
+            this->m_watched.clear();
+            this->m_rebuild = nullptr;
+        }
+        if (this->m_reload.prog != 0)
+        {
+            glDeleteProgram(this->m_reload.prog);
+            this->m_reload.prog = 0;
+        }
+        if (this->progid != 0)
+        {
+            this->del_program();
+            this->progid = 0;
+        }
+    };
+
+    bool prog_t::loadFromPath(const std::filesystem::path &vert_path, const std::filesystem::path &frag_path)
+    {
+        // reload, delete previous
+        if (this->progid != 0)
+        {
+            glDeleteProgram(this->progid);
+            this->progid = 0;
+        }
+
+        auto v_str = readShader_fromfile(vert_path);
+        if (v_str.size() == 0)
+            return false;
+        auto f_str = readShader_fromfile(frag_path);
+        if (f_str.size() == 0)
+            return false;
+
+        if (load(v_str, f_str) == false)
+            return false;
+
+        std::vector<std::filesystem::path> files{std::filesystem::absolute(vert_path).lexically_normal(),
+                                                 std::filesystem::absolute(frag_path).lexically_normal()};
+        this->watch_files(files, [files](std::string &vert, std::string &frag, std::vector<std::filesystem::path> &)
+                          {
+                              vert = readShader_fromfile(files[0]);
+                              frag = readShader_fromfile(files[1]);
+                              return vert.empty() == false && frag.empty() == false;
+                          });
+        return true;
+    };
+
+    void prog_t::watch_files(std::vector<std::filesystem::path> files, rebuild_t rebuild)
+    {
+        auto &watcher = shaderWatcher_t::instance();
+        if (this->m_watched.empty() == false)
+            watcher.unwatch(this);
+        this->m_watched = std::move(files);
+        this->m_rebuild = std::move(rebuild);
+        if (this->m_watched.empty() == false)
+            watcher.watch(this);
+    };
+
+    GLuint prog_t::link_begin(const std::string &vert_glsl, const std::string &frag_glsl)
+    {
+        GLuint shaders[2] = {compile_begin(GL_VERTEX_SHADER, vert_glsl), compile_begin(GL_FRAGMENT_SHADER, frag_glsl)};
+        return link_begin(shaders, 2);
+    };
+
+    GLuint prog_t::compile_begin(GLenum type, const std::string &glsl)
+    {
+        GLuint shader = glCreateShader(type);
+        auto source = glsl.c_str();
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        return shader;
+    };
+
+    GLuint prog_t::link_begin(const GLuint *shaders, int count)
+    {
+        GLuint prog = glCreateProgram();
+        if (prog == 0)
+        {
+            std::cout << "glCreateProgram fail. " << __func__ << std::endl;
+            for (int i = 0; i < count; i++)
+                glDeleteShader(shaders[i]);
+            return 0;
+        }
+        // the hint must be set before linking, otherwise some drivers refuse glGetProgramBinary
+        if (binaryCache_t::instance().enabled())
+            glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+        for (int i = 0; i < count; i++)
+            glAttachShader(prog, shaders[i]);
+        glLinkProgram(prog);
+        return prog;
+    };
+
+    void prog_t::adopt(GLuint prog, const std::string &vert_content, const std::string &frag_content, bool from_cache)
+    {
+        if (this->progid != 0)
+            glDeleteProgram(this->progid);
+        this->progid = prog;
+        if (from_cache == false)
+            binaryCache_t::instance().store(prog, vert_content, frag_content);
+        this->reflect();
+    };
+
+    void progBatch_t::add(prog_t &prog, std::string vert_content, std::string frag_content)
+    {
+        item_t it;
+        it.prog = &prog;
+        it.vert = std::move(vert_content);
+        it.frag = std::move(frag_content);
+        this->m_items.push_back(std::move(it));
+    };
+
+    void progBatch_t::start()
+    {
+        auto &cache = binaryCache_t::instance();
+        // restore what the cache has, then submit every remaining shader before linking anything
+        for (auto &it : this->m_items)
+        {
+            if (it.state != state_t::QUEUED)
+                continue;
+            it.start = clock_t::now();
+            GLuint prog = cache.load(it.vert, it.frag);
+            if (prog != 0)
+            {
+                it.prog->adopt(prog, it.vert, it.frag, true);
+                it.state = state_t::DONE;
+                it.cached = true;
+                it.elapsed = clock_t::now() - it.start;
+                continue;
+            }
+            it.shaders[0] = prog_t::compile_begin(GL_VERTEX_SHADER, it.vert);
+            it.shaders[1] = prog_t::compile_begin(GL_FRAGMENT_SHADER, it.frag);
+            it.state = state_t::COMPILING;
+        }
+        for (auto &it : this->m_items)
+        {
+            if (it.state != state_t::COMPILING)
+                continue;
+            it.linking = prog_t::link_begin(it.shaders, 2);
+            it.state = it.linking == 0 ? state_t::FAILED : state_t::LINKING;
+        }
+    };
+
+    bool progBatch_t::poll()
+    {
+        bool all = true;
+        for (auto &it : this->m_items)
+        {
+            if (it.state != state_t::LINKING)
+                continue;
+            if (prog_t::link_ready(it.linking) == false)
+            {
+                all = false;
+                continue;
+            }
+            this->complete(it);
+        }
+        return all;
+    };
+
+    bool progBatch_t::finish()
+    {
+        for (auto &it : this->m_items)
+        {
+            if (it.state == state_t::LINKING)
+                this->complete(it);
+        }
+        return this->failed() == 0;
+    };
+
+    void progBatch_t::complete(item_t &it)
+    {
+        if (prog_t::link_end(it.linking))
+        {
+            it.prog->adopt(it.linking, it.vert, it.frag, false);
+            it.state = state_t::DONE;
+        }
+        else
+        {
+            it.state = state_t::FAILED;
+        }
+        it.linking = 0;
+        it.elapsed = clock_t::now() - it.start;
+    };
+
+    std::size_t progBatch_t::pending() const
+    {
+        return std::count_if(this->m_items.begin(), this->m_items.end(), [](const item_t &it)
+                             { return it.state == state_t::COMPILING || it.state == state_t::LINKING; });
+    };
+
+    std::size_t progBatch_t::failed() const
+    {
+        return std::count_if(this->m_items.begin(), this->m_items.end(), [](const item_t &it)
+                             { return it.state == state_t::FAILED; });
+    };
+
+    std::uint64_t shaderVariants_t::key(const std::string &vert_source, const std::string &frag_source, const defines_t &defines) const
+    {
+        auto sorted = defines;
+        std::sort(sorted.begin(), sorted.end());
+        auto h = fnv1a(vert_source);
+        h = fnv1a("", 1, h);
+        h = fnv1a(frag_source, h);
+        for (auto &d : sorted)
+        {
+            h = fnv1a("", 1, h);
+            h = fnv1a(d.first, h);
+            h = fnv1a("=", 1, h);
+            h = fnv1a(d.second, h);
+        }
+        return h;
+    };
+
+    bool shaderVariants_t::resolve(const std::string &name, bool quoted, const std::filesystem::path &dir,
+                                   std::string &content, std::string &resolved) const
+    {
+        auto read = [&](const std::filesystem::path &p) -> bool
+        {
+            std::ifstream file(p);
+            if (file.fail())
+                return false;
+            std::ostringstream oss;
+            oss << file.rdbuf();
+            content = oss.str();
+            resolved = p.lexically_normal().string();
+            return true;
+        };
+
+        // "file" is looked up next to the including file first, like the C preprocessor
+        if (quoted && dir.empty() == false && read(dir / name))
+            return true;
+        for (auto &inc : this->m_includeDirs)
+        {
+            if (read(inc / name))
+                return true;
+        }
+        auto v = this->m_virtualFiles.find(name);
+        if (v != this->m_virtualFiles.end())
+        {
+            content = v->second;
+            resolved = name;
+            return true;
+        }
+        return false;
+    };
+
+    bool shaderVariants_t::expand(const std::string &text, const std::filesystem::path &dir, int id, int firstline, int depth,
+                                  std::string &out, std::vector<std::string> &files, std::vector<std::string> &onces) const
+    {
+        if (depth > 32)
+        {
+            std::cout << files[id] << ": #include nested too deeply" << std::endl;
+            return false;
+        }
+
+        std::istringstream iss(text);
+        std::string line;
+        for (int lineno = firstline; std::getline(iss, line); lineno++)
+        {
+            auto p = line.find_first_not_of(" \t");
+            if (p == std::string::npos || line[p] != '#')
+            {
+                out += line;
+                out += '\n';
+                continue;
+            }
+            auto d = line.find_first_not_of(" \t", p + 1);
+            if (d != std::string::npos && line.compare(d, 6, "pragma") == 0 && line.find("once", d + 6) != std::string::npos)
+            {
+                out += '\n';
+                continue;
+            }
+            if (d == std::string::npos || line.compare(d, 7, "include") != 0)
+            {
+                out += line;
+                out += '\n';
+                continue;
+            }
+
+            auto b = line.find_first_of("\"<", d + 7);
+            auto e = b == std::string::npos ? b : line.find(line[b] == '"' ? '"' : '>', b + 1);
+            if (e == std::string::npos)
+            {
+                std::cout << files[id] << ":" << lineno << ": malformed #include" << std::endl;
+                return false;
+            }
+            auto name = line.substr(b + 1, e - b - 1);
+            std::string content, resolved;
+            if (this->resolve(name, line[b] == '"', dir, content, resolved) == false)
+            {
+                std::cout << files[id] << ":" << lineno << ": cannot find include file " << name << std::endl;
+                return false;
+            }
+            if (std::find(onces.begin(), onces.end(), resolved) != onces.end())
+            {
+                out += '\n';
+                continue;
+            }
+            if (content.find("#pragma once") != std::string::npos)
+                onces.push_back(resolved);
+
+            int child = static_cast<int>(files.size());
+            files.push_back(resolved);
+            out += "#line 1 " + std::to_string(child) + "\n";
+            if (this->expand(content, std::filesystem::path(resolved).parent_path(), child, 1, depth + 1, out, files, onces) == false)
+                return false;
+            out += "#line " + std::to_string(lineno + 1) + " " + std::to_string(id) + "\n";
+        }
+        return true;
+    };
+
+    std::string shaderVariants_t::preprocess(const std::string &source, const defines_t &defines,
+                                             const std::filesystem::path &origin,
+                                             std::vector<std::string> *files) const
+    {
+        std::string out;
+        std::vector<std::string> names{origin.empty() ? std::string("<source>") : origin.string()};
+        std::vector<std::string> onces;
+
+        // #version must stay the first directive, the defines follow it
+        std::string body = source;
+        int firstline = 1;
+        auto v = source.find("#version");
+        if (v != std::string::npos && source.find_first_not_of(" \t\r\n", 0) == v)
+        {
+            auto eol = source.find('\n', v);
+            out = source.substr(0, eol == std::string::npos ? source.size() : eol) + "\n";
+            body = eol == std::string::npos ? std::string() : source.substr(eol + 1);
+            firstline = 1 + static_cast<int>(std::count(source.begin(), source.begin() + v, '\n')) + 1;
+        }
+        // sorted like key(), the same variant must give the same text (and binary cache entry) in any order
+        auto sorted = defines;
+        std::sort(sorted.begin(), sorted.end());
+        for (auto &d : sorted)
+            out += "#define " + d.first + " " + d.second + "\n";
+        out += "#line " + std::to_string(firstline) + " 0\n";
+
+        auto dir = origin.empty() ? std::filesystem::path() : origin.parent_path();
+        if (this->expand(body, dir, 0, firstline, 0, out, names, onces) == false)
+            return std::string();
+        if (files != nullptr)
+            *files = std::move(names);
+        return out;
+    };
+
+    prog_t *shaderVariants_t::build(std::uint64_t k, const variant_t &v)
+    {
+        auto &slot = this->m_programs[k];
+        std::vector<std::string> vfiles, ffiles;
+        auto vert = this->preprocess(v.vert, v.defines, v.vert_origin, &vfiles);
+        auto frag = this->preprocess(v.frag, v.defines, v.frag_origin, &ffiles);
+        auto prog = std::make_unique<prog_t>();
+        if (vert.empty() == false && frag.empty() == false && prog->load(vert, frag))
+        {
+            this->watch(*prog, v, vfiles, ffiles);
+            slot = std::move(prog);
+            return slot.get();
+        }
+        std::cout << "shader variant failed:";
+        for (auto &d : v.defines)
+            std::cout << " " << d.first << "=" << d.second;
+        std::cout << std::endl;
+        for (std::size_t i = 0; i < vfiles.size(); i++)
+            std::cout << "  vert source " << i << ": " << vfiles[i] << std::endl;
+        for (std::size_t i = 0; i < ffiles.size(); i++)
+            std::cout << "  frag source " << i << ": " << ffiles[i] << std::endl;
+        slot.reset();
+        return nullptr;
+    };
+
+    std::vector<std::filesystem::path> shaderVariants_t::on_disk(const std::vector<std::string> &vfiles,
+                                                                 const std::vector<std::string> &ffiles) const
+    {
+        std::vector<std::string> names;
+        if (vfiles.empty() == false)
+            names.push_back(vfiles[0]);
+        if (ffiles.empty() == false)
+            names.push_back(ffiles[0]);
+        for (auto *list : {&vfiles, &ffiles})
+            names.insert(names.end(), list->begin() + std::min<std::size_t>(1, list->size()), list->end());
+
+        std::vector<std::filesystem::path> out;
+        for (auto &n : names)
+        {
+            // virtual files and "<source>" have nothing to watch
+            std::error_code ec;
+            if (this->m_virtualFiles.count(n) != 0 || std::filesystem::is_regular_file(n, ec) == false)
+                continue;
+            auto p = std::filesystem::absolute(n).lexically_normal();
+            if (std::find(out.begin(), out.end(), p) == out.end())
+                out.push_back(std::move(p));
+        }
+        return out;
+    };
+
+    void shaderVariants_t::watch(prog_t &prog, const variant_t &v, const std::vector<std::string> &vfiles,
+                                 const std::vector<std::string> &ffiles)
+    {
+        if (v.vert_origin.empty() && v.frag_origin.empty())
+            return;
+        auto files = this->on_disk(vfiles, ffiles);
+        if (files.empty())
+            return;
+
+        variant_t base = v;
+        for (auto *origin : {&base.vert_origin, &base.frag_origin})
+        {
+            if (origin->empty() == false)
+                *origin = std::filesystem::absolute(*origin).lexically_normal();
+        }
+        prog.watch_files(std::move(files), [this, base](std::string &vert, std::string &frag, std::vector<std::filesystem::path> &watched)
+                         {
+                             // the stages without an origin keep their source, the others are read again
+                             variant_t n = base;
+                             if (n.vert_origin.empty() == false)
+                                 n.vert = prog_t::readShader_fromfile(n.vert_origin);
+                             if (n.frag_origin.empty() == false)
+                                 n.frag = prog_t::readShader_fromfile(n.frag_origin);
+                             if (n.vert.empty() || n.frag.empty())
+                                 return false;
+                             std::vector<std::string> vfiles, ffiles;
+                             vert = this->preprocess(n.vert, n.defines, n.vert_origin, &vfiles);
+                             frag = this->preprocess(n.frag, n.defines, n.frag_origin, &ffiles);
+                             if (vert.empty() || frag.empty())
+                                 return false;
+                             watched = this->on_disk(vfiles, ffiles);
+                             return watched.empty() == false;
+                         });
+    };
+
+    prog_t *shaderVariants_t::get(const std::string &vert_source, const std::string &frag_source, const defines_t &defines)
+    {
+        auto k = this->key(vert_source, frag_source, defines);
+        auto iter = this->m_programs.find(k);
+        if (iter != this->m_programs.end())
+            return iter->second.get();
+        return this->build(k, {vert_source, frag_source, {}, {}, defines});
+    };
+
+    prog_t *shaderVariants_t::getFromPath(const std::filesystem::path &vert_path, const std::filesystem::path &frag_path,
+                                          const defines_t &defines)
+    {
+        auto read = [this](const std::filesystem::path &p, std::filesystem::path &found) -> std::string
+        {
+            std::string content, resolved;
+            if (this->resolve(p.string(), true, std::filesystem::current_path(), content, resolved) == false)
+                std::cout << p << ": cannot open shader file" << std::endl;
+            found = resolved;
+            return content;
+        };
+        variant_t v;
+        v.vert = read(vert_path, v.vert_origin);
+        v.frag = read(frag_path, v.frag_origin);
+        v.defines = defines;
+        if (v.vert.empty() || v.frag.empty())
+            return nullptr;
+
+        auto k = this->key(v.vert, v.frag, defines);
+        auto iter = this->m_programs.find(k);
+        if (iter != this->m_programs.end())
+            return iter->second.get();
+        return this->build(k, v);
+    };
+
+    std::size_t shaderVariants_t::precompile(const std::vector<variant_t> &variants)
+    {
+        progBatch_t batch;
+        std::vector<std::uint64_t> keys;
+        std::vector<const variant_t *> built;
+        std::vector<std::pair<std::vector<std::string>, std::vector<std::string>>> files;
+        for (auto &v : variants)
+        {
+            auto k = this->key(v.vert, v.frag, v.defines);
+            if (this->m_programs.count(k) != 0)
+                continue;
+            std::vector<std::string> vfiles, ffiles;
+            auto vert = this->preprocess(v.vert, v.defines, v.vert_origin, &vfiles);
+            auto frag = this->preprocess(v.frag, v.defines, v.frag_origin, &ffiles);
+            auto &slot = this->m_programs[k];
+            if (vert.empty() || frag.empty())
+                continue;
+            slot = std::make_unique<prog_t>();
+            batch.add(*slot, std::move(vert), std::move(frag));
+            keys.push_back(k);
+            built.push_back(&v);
+            files.emplace_back(std::move(vfiles), std::move(ffiles));
+        }
+        batch.start();
+        batch.finish();
+
+        std::size_t failures = 0;
+        for (std::size_t i = 0; i < keys.size(); i++)
+        {
+            if (batch.items()[i].state != progBatch_t::state_t::DONE)
+                this->m_programs[keys[i]].reset();
+            else
+                this->watch(*this->m_programs[keys[i]], *built[i], files[i].first, files[i].second);
+        }
+        for (auto &v : variants)
+        {
+            auto iter = this->m_programs.find(this->key(v.vert, v.frag, v.defines));
+            if (iter == this->m_programs.end() || iter->second == nullptr)
+                failures++;
+        }
+        return failures;
+    };
+
+    stageCache_t &stageCache_t::instance()
+    {
+        static stageCache_t cache;
+        return cache;
+    };
+
+    bool stageCache_t::supported()
+    {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        return major > 4 || (major == 4 && minor >= 1) || has_extension("GL_ARB_separate_shader_objects");
+    };
+
+    std::shared_ptr<prog_t> stageCache_t::get(GLenum type, const std::string &source)
+    {
+        auto k = fnv1a(source, fnv1a(&type, sizeof(type)));
+        auto iter = this->m_stages.find(k);
+        if (iter != this->m_stages.end())
+        {
+            this->m_hits++;
+            return iter->second;
+        }
+
+        auto src = source.c_str();
+        GLuint prog = glCreateShaderProgramv(type, 1, &src);
+        this->m_compiles++;
+        GLint linked = GL_FALSE;
+        if (prog != 0)
+            glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+        if (linked == GL_FALSE)
+        {
+            if (prog != 0)
+            {
+                GLsizei len;
+                glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &len);
+
+                GLchar *log = new GLchar[len + 1];
+                glGetProgramInfoLog(prog, len, &len, log);
+                std::cerr << "Separable stage failed: " << log << std::endl;
+                delete[] log;
+                glDeleteProgram(prog);
+            }
+            return nullptr;
+        }
+
+        auto stage = std::make_shared<prog_t>();
+        stage->progid = prog;
+        stage->m_separable = true;
+        stage->reflect();
+        this->m_stages[k] = stage;
+        return stage;
+    };
+
+    void stageCache_t::purge()
+    {
+        for (auto iter = this->m_stages.begin(); iter != this->m_stages.end();)
+        {
+            if (iter->second.use_count() == 1)
+                iter = this->m_stages.erase(iter);
+            else
+                ++iter;
+        }
+    };
+
+    pipeline_t::~pipeline_t()
+    {
+        if (this->pipelineid != 0)
+            glDeleteProgramPipelines(1, &this->pipelineid);
+    };
+
+    bool pipeline_t::load(const std::string &vert_content, const std::string &frag_content)
+    {
+        if (stageCache_t::supported() == false)
+        {
+            std::cout << "separate shader objects are not supported by this context" << std::endl;
+            return false;
+        }
+
+        auto &cache = stageCache_t::instance();
+        auto vert = cache.get(GL_VERTEX_SHADER, vert_content);
+        auto frag = cache.get(GL_FRAGMENT_SHADER, frag_content);
+        if (vert == nullptr || frag == nullptr)
+            return false;
+
+        if (this->pipelineid == 0)
+            glGenProgramPipelines(1, &this->pipelineid);
+        glUseProgramStages(this->pipelineid, GL_VERTEX_SHADER_BIT, vert->progid);
+        glUseProgramStages(this->pipelineid, GL_FRAGMENT_SHADER_BIT, frag->progid);
+        this->m_vert = std::move(vert);
+        this->m_frag = std::move(frag);
+
+        // interface mismatches between the stages only show up here
+        glValidateProgramPipeline(this->pipelineid);
+        GLint valid = GL_FALSE;
+        glGetProgramPipelineiv(this->pipelineid, GL_VALIDATE_STATUS, &valid);
+        if (valid == GL_FALSE)
+        {
+            GLsizei len = 0;
+            glGetProgramPipelineiv(this->pipelineid, GL_INFO_LOG_LENGTH, &len);
+            std::vector<GLchar> log(len + 1);
+            glGetProgramPipelineInfoLog(this->pipelineid, len, &len, log.data());
+            std::cout << "pipeline[" << this->pipelineid << "] validation: " << log.data() << std::endl;
+        }
+        return true;
+    };
+
+    bool pipeline_t::use()
+    {
+        if (this->pipelineid == 0)
+            return false;
+
+        // a program bound with glUseProgram takes precedence over the pipeline
+        glUseProgram(0);
+        glBindProgramPipeline(this->pipelineid);
+        return true;
+    };
+
+    bool prog_t::link_ready(GLuint prog)
+    {
+        static const bool parallel = has_extension("GL_KHR_parallel_shader_compile") ||
+                                     has_extension("GL_ARB_parallel_shader_compile");
+        if (parallel == false)
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(prog, GL_COMPLETION_STATUS_KHR, &done);
+        return done != GL_FALSE;
+    };
+
+    bool prog_t::link_end(GLuint &prog)
+    {
+        GLuint shaders[8];
+        GLsizei count = 0;
+        glGetAttachedShaders(prog, 8, &count, shaders);
+
+        bool ok = true;
+        for (GLsizei i = 0; i < count; i++)
+        {
+            GLint success;
+            glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                GLsizei len;
+                glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &len);
+
+                GLchar *log = new GLchar[len + 1];
+                glGetShaderInfoLog(shaders[i], len, &len, log);
+                std::cerr << "Shader compilation failed: " << log << std::endl;
+                delete[] log;
+                ok = false;
+            }
+        }
+
+        // check for linking errors
+        GLint linked;
+        glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+        if (ok && !linked)
+        {
+            GLsizei len;
+            glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &len);
+
+            GLchar *log = new GLchar[len + 1];
+            glGetProgramInfoLog(prog, len, &len, log);
+            std::cerr << "Shader linking failed: " << log << std::endl;
+            delete[] log;
+            ok = false;
+        }
+
+        //在把着色器对象链接到程序对象以后，记得删除着色器对象，我们不再需要它们了
+        for (GLsizei i = 0; i < count; i++)
+        {
+            glDetachShader(prog, shaders[i]);
+            glDeleteShader(shaders[i]);
+        }
+        if (ok == false)
+        {
+            glDeleteProgram(prog);
+            prog = 0;
+        }
+        return ok;
+    };
+
+    void prog_t::reload_begin(std::string vert_content, std::string frag_content)
+    {
+        // a newer edit supersedes a reload still in flight
+        if (this->m_reload.prog != 0)
+        {
+            GLuint shaders[8];
+            GLsizei count = 0;
+            glGetAttachedShaders(this->m_reload.prog, 8, &count, shaders);
+            for (GLsizei i = 0; i < count; i++)
+                glDeleteShader(shaders[i]);
+            glDeleteProgram(this->m_reload.prog);
+        }
+
+        this->m_reload.vert = std::move(vert_content);
+        this->m_reload.frag = std::move(frag_content);
+        this->m_reload.prog = binaryCache_t::instance().load(this->m_reload.vert, this->m_reload.frag);
+        if (this->m_reload.prog == 0)
+            this->m_reload.prog = link_begin(this->m_reload.vert, this->m_reload.frag);
+    };
+
+    void prog_t::reload_poll()
+    {
+        if (this->m_reload.prog == 0 || link_ready(this->m_reload.prog) == false)
+            return;
+
+        auto &watcher = shaderWatcher_t::instance();
+        // the stage sources come first in m_watched, the includes follow
+        auto sources = [this](std::ostream &os) -> std::ostream &
+        {
+            for (std::size_t i = 0; i < this->m_watched.size() && i < 2; i++)
+                os << (i == 0 ? "" : ", ") << this->m_watched[i];
+            return os;
+        };
+        // programs restored from the binary cache have no attached shaders and are already linked
+        GLint attached = 0;
+        glGetProgramiv(this->m_reload.prog, GL_ATTACHED_SHADERS, &attached);
+        if (attached > 0 && link_end(this->m_reload.prog) == false)
+        {
+            sources(std::cout) << ": reload failed, keep program[" << this->progid << "]" << std::endl;
+            watcher.m_failures++;
+            this->m_reload = reload_t();
+            return;
+        }
+
+        // swap, the caller is at a frame boundary
+        auto r = std::move(this->m_reload);
+        this->m_reload = reload_t();
+        this->adopt(r.prog, r.vert, r.frag, attached == 0);
+        watcher.m_reloads++;
+        sources(std::cout << "program[" << this->progid << "] reloaded from ") << std::endl;
+    };
+
+    bool has_extension(std::string_view name)
+    {
+        static std::vector<std::string> exts;
+        static bool queried = false;
+        if (queried == false)
+        {
+            queried = true;
+            GLint n = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+            for (GLint i = 0; i < n; i++)
+            {
+                auto e = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+                if (e != nullptr)
+                    exts.emplace_back(e);
+            }
+        }
+        return std::find(exts.begin(), exts.end(), name) != exts.end();
+    };
+
+    shaderWatcher_t &shaderWatcher_t::instance()
+    {
+        static shaderWatcher_t watcher;
+        return watcher;
+    };
+
+    void shaderWatcher_t::watch(prog_t *prog)
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_progs.push_back(prog);
+        for (auto &p : prog->m_watched)
+        {
+            if (this->m_files[p.string()]++ == 0 && this->m_fd >= 0)
+                this->add_watch_locked(p.parent_path());
+        }
+    };
+
+    void shaderWatcher_t::unwatch(prog_t *prog)
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        auto iter = std::find(this->m_progs.begin(), this->m_progs.end(), prog);
+        if (iter == this->m_progs.end())
+            return;
+        this->m_progs.erase(iter);
+        for (auto &p : prog->m_watched)
+        {
+            auto f = this->m_files.find(p.string());
+            if (f != this->m_files.end() && --f->second == 0)
+                this->m_files.erase(f);
+        }
+        // directory watches are kept until stop(), they are cheap and usually reused
+    };
+
+    void shaderWatcher_t::poll()
+    {
+        std::unordered_set<std::string> changed;
+        std::vector<prog_t *> progs;
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            changed.swap(this->m_changed);
+            progs = this->m_progs;
+        }
+
+        for (auto prog : progs)
+        {
+            bool hit = false;
+            for (std::size_t i = 0; i < prog->m_watched.size() && changed.empty() == false && hit == false; i++)
+                hit = changed.count(prog->m_watched[i].string()) != 0;
+            if (hit == false)
+            {
+                prog->reload_poll();
+                continue;
+            }
+
+            // the sources are rebuilt from disk, an edited include can add or drop files
+            std::string vert, frag;
+            auto files = prog->m_watched;
+            if (prog->m_rebuild == nullptr || prog->m_rebuild(vert, frag, files) == false)
+            {
+                std::cout << prog->m_watched.front() << ": reload skipped, the sources do not preprocess" << std::endl;
+                this->m_failures++;
+                continue;
+            }
+            if (files != prog->m_watched)
+                prog->watch_files(std::move(files), prog->m_rebuild);
+            prog->reload_begin(std::move(vert), std::move(frag));
+            // the status is queried at the next frame at the earliest
+        }
+    };
+
+#if defined(__linux__)
+    bool shaderWatcher_t::start()
+    {
+        if (this->running())
+            return true;
+
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (this->m_fd < 0)
+        {
+            std::cout << "inotify_init1 fail. " << __func__ << std::endl;
+            return false;
+        }
+        for (auto &f : this->m_files)
+            this->add_watch_locked(std::filesystem::path(f.first).parent_path());
+
+        if (has_extension("GL_KHR_parallel_shader_compile"))
+        {
+#ifdef GL_KHR_parallel_shader_compile
+            // let the driver use as many compiler threads as it likes
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#endif
+        }
+        this->m_parallel = has_extension("GL_KHR_parallel_shader_compile") || has_extension("GL_ARB_parallel_shader_compile");
+        if (this->m_parallel == false)
+            std::cout << "no GL_KHR_parallel_shader_compile: a shader reload blocks the render thread on its link status "
+                         "one frame after the edit" << std::endl;
+
+        this->m_stop = false;
+        this->m_thread = std::thread(&shaderWatcher_t::run, this);
+        return true;
+    };
+
+    void shaderWatcher_t::stop()
+    {
+        if (this->running() == false)
+            return;
+        this->m_stop = true;
+        this->m_thread.join();
+        close(this->m_fd);
+        this->m_fd = -1;
+        this->m_dirs.clear();
+    };
+
+    void shaderWatcher_t::add_watch_locked(const std::filesystem::path &dir)
+    {
+        for (auto &d : this->m_dirs)
+        {
+            if (d.second == dir)
+                return;
+        }
+        int wd = inotify_add_watch(this->m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0)
+        {
+            std::cout << dir << ": inotify_add_watch fail" << std::endl;
+            return;
+        }
+        this->m_dirs[wd] = dir;
+    };
+
+    void shaderWatcher_t::run()
+    {
+        alignas(struct inotify_event) char buf[4096];
+        while (this->m_stop == false)
+        {
+            struct pollfd pfd = {this->m_fd, POLLIN, 0};
+            if (::poll(&pfd, 1, 200) <= 0)
+                continue;
+
+            std::vector<std::string> paths;
+            for (ssize_t len; (len = read(this->m_fd, buf, sizeof(buf))) > 0;)
+            {
+                for (char *p = buf; p < buf + len;)
+                {
+                    auto ev = reinterpret_cast<struct inotify_event *>(p);
+                    p += sizeof(struct inotify_event) + ev->len;
+                    if (ev->len == 0)
+                        continue;
+
+                    std::lock_guard<std::mutex> lock(this->m_mutex);
+                    auto dir = this->m_dirs.find(ev->wd);
+                    if (dir == this->m_dirs.end())
+                        continue;
+                    auto path = (dir->second / ev->name).string();
+                    if (this->m_files.count(path) != 0)
+                        paths.push_back(path);
+                }
+            }
+
+            // editors emit several events per save, they collapse into one entry
+            for (auto &path : paths)
+            {
+                std::error_code ec;
+                if (std::filesystem::file_size(path, ec) == 0 || ec)
+                    continue; // truncated, the final write follows
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                this->m_changed.insert(path);
+            }
+        }
+    };
+#else
+    bool shaderWatcher_t::start()
+    {
+        std::cout << "shader hot reload needs inotify, not supported on this platform" << std::endl;
+        return false;
+    };
+    void shaderWatcher_t::stop(){};
+    void shaderWatcher_t::add_watch_locked(const std::filesystem::path &dir){};
+    void shaderWatcher_t::run(){};
+#endif
+    bool prog_t::load(const std::string &vert_content, const std::string &frag_content)
+    {
+        auto &cache = binaryCache_t::instance();
+        this->progid = cache.load(vert_content, frag_content);
+        if (this->progid == 0)
+        {
+            this->progid = create_link_program(vert_content, frag_content);
+            if (this->progid == 0)
+                return false;
+
+            cache.store(this->progid, vert_content, frag_content);
+        }
+
+        this->reflect();
+        return true;
+    };
+
+    bool prog_t::shadow_unchanged(GLint loc, const void *bytes, std::size_t len)
+    {
+        if (loc < 0 || static_cast<std::size_t>(loc) >= this->m_shadow.size() || len > sizeof(shadow_t::bytes))
+            return false;
+
+        auto &sh = this->m_shadow[loc];
+        if (sh.size == len && std::memcmp(sh.bytes, bytes, len) == 0)
+            return true;
+        sh.size = static_cast<std::uint8_t>(len);
+        std::memcpy(sh.bytes, bytes, len);
+        return false;
+    };
+
+    void prog_t::reflect()
+    {
+        this->m_uniforms.clear();
+        this->m_shadow.clear();
+
+        GLint count = 0, maxlen = 0;
+        glGetProgramiv(this->progid, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->progid, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxlen);
+        std::vector<GLchar> buf(std::max(maxlen, 1) + 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei len = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(this->progid, i, static_cast<GLsizei>(buf.size()), &len, &size, &type, buf.data());
+            std::string name(buf.data(), len);
+
+            // members of uniform blocks have no location
+            GLint loc = glGetUniformLocation(this->progid, name.c_str());
+            if (loc == -1)
+                continue;
+
+            // arrays are reported as "name[0]"; make "name" and every "name[i]" resolvable as well
+            auto bracket = name.size() > 3 ? name.rfind("[0]") : std::string::npos;
+            if (bracket != std::string::npos && bracket + 3 == name.size())
+            {
+                auto base = name.substr(0, bracket);
+                this->m_uniforms.insert(base, loc, type, size);
+                for (GLint e = 1; e < size; e++)
+                {
+                    auto elem = base + "[" + std::to_string(e) + "]";
+                    this->m_uniforms.insert(elem, glGetUniformLocation(this->progid, elem.c_str()), type, 1);
+                }
+            }
+            this->m_uniforms.insert(std::move(name), loc, type, size);
+        }
+
+        // seed the shadow copies with the values the program holds right after link
+        // (zero, or the GLSL initializer), so that e.g. setting a sampler to unit 0 costs nothing
+        GLint maxloc = -1;
+        for (auto &e : this->m_uniforms)
+            maxloc = std::max(maxloc, e.location);
+        this->m_shadow.resize(maxloc + 1);
+        for (auto &e : this->m_uniforms)
+        {
+            if (e.location < 0)
+                continue;
+            auto &sh = this->m_shadow[e.location];
+            switch (e.type)
+            {
+            case GL_FLOAT:
+            case GL_FLOAT_VEC3:
+            case GL_FLOAT_MAT4:
+                sh.size = static_cast<std::uint8_t>(sizeof(GLfloat) * (e.type == GL_FLOAT ? 1 : (e.type == GL_FLOAT_VEC3 ? 3 : 16)));
+                glGetUniformfv(this->progid, e.location, reinterpret_cast<GLfloat *>(sh.bytes));
+                break;
+            case GL_INT:
+            case GL_BOOL:
+            case GL_SAMPLER_2D:
+            case GL_SAMPLER_3D:
+            case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_2D_SHADOW:
+                sh.size = sizeof(GLint);
+                glGetUniformiv(this->progid, e.location, reinterpret_cast<GLint *>(sh.bytes));
+                break;
+            default:
+                break;
+            }
+        }
+
+        // connect the blocks shared through uniformBlock_t to their binding points
+        auto &blocks = uniformBlock_t::registry();
+        if (blocks.empty())
+            return;
+        GLint nblocks = 0;
+        glGetProgramiv(this->progid, GL_ACTIVE_UNIFORM_BLOCKS, &nblocks);
+        for (GLint i = 0; i < nblocks; i++)
+        {
+            GLsizei len = 0;
+            glGetActiveUniformBlockName(this->progid, i, static_cast<GLsizei>(buf.size()), &len, buf.data());
+            auto iter = blocks.find(std::string(buf.data(), len));
+            if (iter == blocks.end())
+                continue;
+            GLint datasize = 0;
+            glGetActiveUniformBlockiv(this->progid, i, GL_UNIFORM_BLOCK_DATA_SIZE, &datasize);
+            if (datasize > iter->second.size)
+                std::cout << iter->first << ": uniform block layout in program[" << this->progid
+                          << "] is larger than the declared std140 layout" << std::endl;
+            glUniformBlockBinding(this->progid, i, iter->second.binding);
+        }
+    };
+
+    std::unordered_map<std::string, uniformBlock_t::registered_t> &uniformBlock_t::registry()
+    {
+        static std::unordered_map<std::string, registered_t> blocks;
+        return blocks;
+    };
+
+    uniformBlock_t::~uniformBlock_t()
+    {
+        if (this->m_ubo == 0)
+            return;
+        auto &blocks = registry();
+        auto iter = blocks.find(this->m_name);
+        if (iter != blocks.end() && iter->second.binding == this->m_binding)
+            blocks.erase(iter);
+        glDeleteBuffers(1, &this->m_ubo);
+    };
+
+    bool uniformBlock_t::create(GLenum usage)
+    {
+        if (this->m_ubo != 0 || this->m_size == 0)
+            return false;
+
+        GLint maxbindings = 0;
+        glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &maxbindings);
+        if (this->m_binding >= static_cast<GLuint>(maxbindings))
+        {
+            std::cout << this->m_name << ": binding point " << this->m_binding << " exceeds GL_MAX_UNIFORM_BUFFER_BINDINGS" << std::endl;
+            return false;
+        }
+
+        // std140 block sizes are rounded up to a vec4
+        this->m_size = (this->m_size + 15) / 16 * 16;
+        this->m_data.assign(this->m_size, 0);
+
+        glGenBuffers(1, &this->m_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->m_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, this->m_size, this->m_data.data(), usage);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, this->m_binding, this->m_ubo);
+
+        registry()[this->m_name] = {this->m_binding, this->m_size};
+        return true;
+    };
+
+    bool uniformBlock_t::attach(const prog_t &prog) const
+    {
+        if (prog.progid == 0)
+            return false;
+        GLuint index = glGetUniformBlockIndex(prog.progid, this->m_name.c_str());
+        if (index == GL_INVALID_INDEX)
+            return false;
+        glUniformBlockBinding(prog.progid, index, this->m_binding);
+        return true;
+    };
+
+    const uniformBlock_t::member_t *uniformBlock_t::find(std::string_view member) const
+    {
+        for (auto &m : this->m_members)
+        {
+            if (m.name == member)
+                return &m;
+        }
+        return nullptr;
+    };
+
+    void uniformBlock_t::mark_dirty(GLsizeiptr offset, GLsizeiptr len)
+    {
+        if (this->m_dirtyBegin == this->m_dirtyEnd)
+        {
+            this->m_dirtyBegin = offset;
+            this->m_dirtyEnd = offset + len;
+            return;
+        }
+        this->m_dirtyBegin = std::min(this->m_dirtyBegin, offset);
+        this->m_dirtyEnd = std::max(this->m_dirtyEnd, offset + len);
+    };
+
+    void uniformBlock_t::upload()
+    {
+        if (this->m_ubo == 0 || this->m_dirtyBegin == this->m_dirtyEnd)
+            return;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, this->m_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, this->m_dirtyBegin, this->m_dirtyEnd - this->m_dirtyBegin,
+                        this->m_data.data() + this->m_dirtyBegin);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        this->m_dirtyBegin = this->m_dirtyEnd = 0;
+    };
+
+    void uniformTable_t::clear()
+    {
+        this->m_entries.clear();
+        this->m_slots.clear();
+    };
+
+    void uniformTable_t::rehash(std::size_t slots)
+    {
+        this->m_slots.assign(slots, -1);
+        const auto mask = slots - 1;
+        for (std::size_t i = 0; i < this->m_entries.size(); i++)
+        {
+            auto s = this->m_entries[i].hash & mask;
+            while (this->m_slots[s] != -1)
+                s = (s + 1) & mask;
+            this->m_slots[s] = static_cast<std::int32_t>(i);
+        }
+    };
+
+    void uniformTable_t::insert(std::string name, GLint location, GLenum type, GLint size)
+    {
+        if (this->find(name) != nullptr)
+            return;
+
+        auto h = fnv1a(name.data(), name.size());
+        this->m_entries.push_back({std::move(name), location, type, size, h});
+        // keep the load factor at or below 1/2
+        if (this->m_slots.size() < this->m_entries.size() * 2)
+        {
+            this->rehash(std::max<std::size_t>(16, this->m_slots.size() * 2));
+            return;
+        }
+        const auto mask = this->m_slots.size() - 1;
+        auto s = h & mask;
+        while (this->m_slots[s] != -1)
+            s = (s + 1) & mask;
+        this->m_slots[s] = static_cast<std::int32_t>(this->m_entries.size() - 1);
+    };
+
+    const uniformTable_t::entry_t *uniformTable_t::find(std::string_view name) const
+    {
+        if (this->m_slots.empty())
+            return nullptr;
+
+        auto h = fnv1a(name.data(), name.size());
+        const auto mask = this->m_slots.size() - 1;
+        for (auto s = h & mask; this->m_slots[s] != -1; s = (s + 1) & mask)
+        {
+            auto &e = this->m_entries[this->m_slots[s]];
+            if (e.hash == h && e.name == name)
+                return &e;
+        }
+        return nullptr;
+    };
+
+    GLuint prog_t::create_link_program(std::string vert_glsl, std::string frag_glsl)
+    {
+        // both stages are submitted before any status query, the driver may compile them concurrently
+        GLuint program = link_begin(vert_glsl, frag_glsl);
+        if (program == 0 || link_end(program) == false)
+            return 0;
+        return program;
+    };
+    void prog_t::del_program()
+    {
+        glDeleteProgram(this->progid);
+    };
+
+    std::basic_string<GLchar> prog_t::readShader_fromfile(const std::filesystem::path &_path)
+    {
+        std::basic_string<GLchar> out;
+        std::ifstream file(_path);
+        if (file.fail())
+        {
+            return out;
+        }
+
+        std::ostringstream oss;
+        oss << file.rdbuf();
+        out = oss.str();
+        file.close();
+
+        return out;
+    };
+
+};
+
+namespace trans
+{
+    // 通过反射关系，从入射/发现求出反射向量
+    // lightdir : 入射向量， 必须是单位向量, 光源 ->反射点
+    // normal :  法线 。  必须是单位向量
+    // 结果：  反射向量
+    Eigen::Vector3f reflect(Eigen::Vector3f lightdir, Eigen::Vector3f normal) //得到反射方向
+    {
+        // L     N     R
+        //       |
+        //      /|
+        //  \  / |    /
+        //   \/  |   /
+        //    \  |  /
+        //     \ | /
+        // -----\|/----------------------
+        // 构造菱形
+        lightdir = -lightdir;
+        Eigen::Vector3f result;
+        auto cos_theta = lightdir.dot(normal);
+        result = (2 * cos_theta * normal - lightdir);
+        result.normalize();
+        return result;
+    }
+
+    // eigen 实现 右手系范围是[-1,1] glm:: perspective 函数，"返回结果.data()" 作为传递uniform的参数
+    // 例子: auto projection = trans::perspective<GLfloat>(...);
+    //       glUniformMatrix4fv(glGetUniformLocation(prog, "projection"), 1, GL_FALSE, projection.data());
+    //
+    // fovy : Field of View,视野，通常设置为45度
+    // aspect： 视口宽高比
+    // near : 就是投影面，其值是投影面距离视点的距离，
+    // far  : 是视景体的后截面，其值是后截面距离视点的距离。far 和 near 的差值，就是视景体的深度。
+    Eigen::Matrix<GLfloat, 4, 4> perspective(GLfloat fovy, GLfloat aspectRatio, GLfloat zNear, GLfloat zFar)
+    {
+        Eigen::Matrix<GLfloat, 4, 4> Result;
+        //[formula](http://openglbook.com/the-book/chapter-4-entering-the-third-dimension/)
+
+        //     [ xScale   0                 0                        0               ]
+        // P = [   0    yScale              0                        0               ]
+        //     [   0      0    -(zFar+zNear)/(zFar-zNear) -2*zNear*zFar/(zFar-zNear) ]
+        //     [   0      0                -1                        0               ]
+        // yScale = cot(fovY/2)
+        // xScale = yScale/aspectRatio
+        auto yScale = 1.0f / std::tan(fovy / 2.0f);
+        auto xScale = yScale / aspectRatio;
+        Result << xScale, 0, 0, 0,
+            0, yScale, 0, 0,
+            0, 0, -(zFar + zNear) / (zFar - zNear), -2 * zNear * zFar / (zFar - zNear),
+            0, 0, -1, 0;
+        return Result;
+
+        // GLfloat const tanHalfFovy = std::tan(fovy / 2.0f);
+        // Result = Eigen::Matrix<GLfloat, 4, 4>::Zero();
+        // Result(0, 0) = 1.0f / (aspect * tanHalfFovy);
+        // Result(1, 1) = 1.0f / (tanHalfFovy);
+        // Result(2, 2) = -(zFar + zNear) / (zFar - zNear);
+        // Result(2, 3) = -1.0f;
+        // Result(3, 2) = -(2.0f * zFar * zNear) / (zFar - zNear);
+        // return Result.transpose();
+    };
+    //正交变换
+    Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor> ortho(GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar)
+    {
+        Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor> Result;
+        Result = Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor>::Identity();
+        Result(0, 0) = 2.0f / (right - left);
+        Result(1, 1) = 2.0f / (top - bottom);
+        Result(2, 2) = -2.0f / (zFar - zNear);
+        Result(0, 3) = -(right + left) / (right - left);
+        Result(1, 3) = -(top + bottom) / (top - bottom);
+        Result(2, 3) = -(zFar + zNear) / (zFar - zNear);
+        return Result;
+    };
+
+};
+
+namespace cv
+{
+    // eye: 在世界坐标中摄像机位置. 眼睛在哪儿
+    // center: 在世界坐标中场景原点. 、看哪儿
+    // up:  在世界坐标中上向量(Up Vector). 头顶朝哪儿
+    //
+    // eigen 实现 glm:: lookAt 函数，"返回结果.data()" 作为传递uniform的参数
+    // 例子: auto view_eigen=trans::lookAt( Eigen::Vector3f(camX, 0.0f, camZ),... );
+    //       glUniformMatrix4fv(glGetUniformLocation(prog, "view"), 1, GL_FALSE,  view_eigen.data());
+    Eigen::Matrix<GLfloat, 4, 4> lookAt(const Eigen::Vector3f &eye, const Eigen::Vector3f &center, const Eigen::Vector3f &up)
+    {
+        // 得到相机坐标系(u-v-n) ,该坐标系是左手坐标系统。而opgen相机坐标系是右手系
+        Eigen::Vector3f n(center - eye); // n 代表 opgen相机坐标系"+Z轴"反向
+        n.normalize();
+
+        Eigen::Vector3f u(n.cross(up)); // u 代表 opgen相机坐标系"+X轴"
+        u.normalize();
+
+        Eigen::Vector3f v(u.cross(n)); //  v 代表 opgen相机坐标系"+Y轴"
+        v.normalize();
+
+        Eigen::Matrix<GLfloat, 4, 4> Result;
+        Result << u.x(), u.y(), u.z(), -u.dot(eye),
+            v.x(), v.y(), v.z(), -v.dot(eye),
+            -n.x(), -n.y(), -n.z(), n.dot(eye),
+            0, 0, 0, 1;
+        return Result;
+    };
+
+    // constructor with vectors
+    camera_t::camera_t(Eigen::Vector3f position,
+                       Eigen::Vector3f up,
+                       GLfloat yaw, GLfloat pitch)
+    {
+        Front = Eigen::Vector3f(0.0f, 0.0f, -1.0f);
+        Position = position;
+
+        WorldUp = up;
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
+    // returns the view matrix calculated using Euler Angles and the LookAt Matrix
+    Eigen::Matrix<GLfloat, 4, 4> camera_t::GetViewMatrix()
+    {
+        return lookAt(Position, Eigen::Vector3f(Position + Front), Up);
+    };
+
+    // processes input received from any keyboard-like input system. Accepts input parameter in the form
+    // of camera defined ENUM (to abstract it from windowing systems)
+    void camera_t::ProcessKeyboard(Camera_Movement direction, GLfloat deltaTime)
+    {
+        // std::cout << "backward" << std::endl;
+        GLfloat velocity = MovementSpeed * deltaTime;
+        if (direction == Camera_Movement::FORWARD)
+        {
+            Position += Front * velocity;
+        }
+        else if (direction == Camera_Movement::BACKWARD)
+        {
+            Position -= Front * velocity;
+        }
+        else if (direction == Camera_Movement::LEFT)
+        {
+            Position -= Right * velocity;
+        }
+        else if (direction == Camera_Movement::RIGHT)
+        {
+            Position += Right * velocity;
+        }
+    }
+
+    // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
+    void camera_t::ProcessMouseMovement(GLfloat xoffset, GLfloat yoffset, GLboolean constrainPitch)
+    {
+        xoffset *= MouseSensitivity;
+        yoffset *= MouseSensitivity;
+
+        this->Yaw += xoffset;
+        this->Pitch += yoffset;
+
+        // make sure that when pitch is out of bounds, screen doesn't get flipped
+        if (constrainPitch)
+        {
+            if (Pitch > 89.0f)
+                Pitch = 89.0f;
+            if (Pitch < -89.0f)
+                Pitch = -89.0f;
+        }
+
+        // update Front, Right and Up Vectors using the updated Euler angles
+        updateCameraVectors();
+    }
+
+    // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
+    void camera_t::ProcessMouseScroll(GLfloat yoffset)
+    {
+        Zoom -= (GLfloat)yoffset;
+        if (Zoom < 1.0f)
+            Zoom = 1.0f;
+        if (Zoom > 45.0f)
+            Zoom = 45.0f;
+    }
+
+    // calculates the front vector from the Camera's (updated) Euler Angles
+    void camera_t::updateCameraVectors()
+    {
+        auto radians = [](GLfloat degrees) -> GLfloat
+        {
+            return degrees * static_cast<GLfloat>(0.01745329251994329576923690768489f);
+        };
+
+        auto eulerAngle_to_vector = [](GLfloat pitch /*俯仰角*/, GLfloat yaw /*偏航角*/) -> Eigen::Vector3f
+        {
+            //右手坐标系
+            auto radians = [](GLfloat v) -> GLfloat
+            {
+                return (v * M_PI) / 180;
+            };
+            pitch = radians(pitch);
+            yaw = radians(yaw);
+            //
+            Eigen::Vector3f front;
+            front.y() = (std::sin(pitch));
+
+            front.x() = (std::cos(yaw) * std::cos(pitch));
+            front.z() = (std::sin(yaw) * std::cos(pitch));
+            front.normalize();
+            return front;
+        };
+
+        this->Front = eulerAngle_to_vector(this->Pitch, this->Yaw);
 
-        // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats
-        // this process on its children nodes (if any).
-        void processNode(aiNode *node, const aiScene *scene);
+        // u cross v:  cross product 含义是u、v 所构成平面的法向
+        // also re-calculate the Right and Up vector
+        auto c = this->Front.cross(this->WorldUp);
+        c.normalize();
+        this->Right = c; // normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
+        auto cc = this->Right.cross(this->Front);
+        cc.normalize();
+        this->Up = cc;
+    }
 
-        void SetVertexBoneDataToDefault(mesh_t::vertex_t &vertex);
+};
 
-        mesh_t processMesh(aiMesh *mesh, const aiScene *scene);
+namespace shaders
+{
 
-        void SetVertexBoneData(mesh_t::vertex_t &vertex, int boneID, float weight);
+    std::vector<vertexFormat_t::attrib_t> vertexFormat_t::attribs() const
+    {
+        std::vector<attrib_t> out;
+        GLsizei offset = 0;
+        auto add = [&](GLuint location, GLint size, GLenum type, GLboolean normalized, GLsizei bytes)
+        {
+            out.push_back({location, size, type, normalized, offset});
+            offset += bytes;
+        };
 
-        void ExtractBoneWeightForVertices(std::vector<mesh_t::vertex_t> &vertices,
-                                          aiMesh *mesh, const aiScene *scene);
+        if (this->position == position_t::QUANT16)
+            add(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 8); // padded to 4 components
+        else
+            add(0, 3, GL_FLOAT, GL_FALSE, 12);
 
-        unsigned int TextureFromFile(const std::string &filename,
-                                     const std::string &directory, bool gamma = false);
-        // checks all material textures of a given type and loads the textures if they're not loaded yet.
-        // the required info is returned as a Texture struct.
-        std::vector<mesh_t::texture_t> loadMaterialTextures(aiMaterial *mat,
-                                                            aiTextureType type, std::string typeName);
+        switch (this->normal)
+        {
+        case normal_t::FLOAT3:
+            add(1, 3, GL_FLOAT, GL_FALSE, 12);
+            break;
+        case normal_t::OCT16:
+            add(1, 2, GL_SHORT, GL_TRUE, 4);
+            break;
+        case normal_t::INT_2_10_10_10:
+            add(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 4);
+            break;
+        default:
+            break;
+        }
+
+        switch (this->texcoord)
+        {
+        case texcoord_t::FLOAT2:
+            add(2, 2, GL_FLOAT, GL_FALSE, 8);
+            break;
+        case texcoord_t::HALF2:
+            add(2, 2, GL_HALF_FLOAT, GL_FALSE, 4);
+            break;
+        case texcoord_t::UNORM16:
+            add(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, 4);
+            break;
+        default:
+            break;
+        }
+
+        switch (this->tangent)
+        {
+        case tangent_t::FLOAT3:
+            add(3, 3, GL_FLOAT, GL_FALSE, 12);
+            add(4, 3, GL_FLOAT, GL_FALSE, 12);
+            break;
+        case tangent_t::QTANGENT:
+            add(3, 4, GL_SHORT, GL_TRUE, 8);
+            break;
+        default:
+            break;
+        }
+        return out;
     };
 
-};
+    GLsizei vertexFormat_t::stride() const
+    {
+        GLsizei bytes = this->position == position_t::QUANT16 ? 8 : 12;
+        bytes += this->normal == normal_t::FLOAT3 ? 12 : (this->normal == normal_t::NONE ? 0 : 4);
+        bytes += this->texcoord == texcoord_t::FLOAT2 ? 8 : (this->texcoord == texcoord_t::NONE ? 0 : 4);
+        bytes += this->tangent == tangent_t::FLOAT3 ? 24 : (this->tangent == tangent_t::NONE ? 0 : 8);
+        return bytes;
+    };
 
-namespace trans
+    std::vector<std::pair<std::string, std::string>> vertexFormat_t::defines() const
+    {
+        static const char *positions[] = {"VTX_POSITION_FLOAT3", "VTX_POSITION_QUANT16"};
+        static const char *normals[] = {"VTX_NORMAL_FLOAT3", "VTX_NORMAL_OCT16", "VTX_NORMAL_INT_2_10_10_10", "VTX_NORMAL_NONE"};
+        static const char *texcoords[] = {"VTX_TEXCOORD_FLOAT2", "VTX_TEXCOORD_HALF2", "VTX_TEXCOORD_UNORM16", "VTX_TEXCOORD_NONE"};
+        static const char *tangents[] = {"VTX_TANGENT_FLOAT3", "VTX_TANGENT_QTANGENT", "VTX_TANGENT_NONE"};
+        return {{positions[static_cast<int>(this->position)], "1"},
+                {normals[static_cast<int>(this->normal)], "1"},
+                {texcoords[static_cast<int>(this->texcoord)], "1"},
+                {tangents[static_cast<int>(this->tangent)], "1"}};
+    };
+
+    const std::string &vertexFormat_t::glsl_decode()
+    {
+        static const std::string text = R"glsl(#pragma once
+// attribute inputs and decoders matching shaders::vertexFormat_t, select the format with vertexFormat_t::defines()
+layout(location = 0) in vec3 vtx_position;
+#ifdef VTX_POSITION_QUANT16
+uniform vec3 dequant_scale;
+uniform vec3 dequant_offset;
+vec3 vertex_position() { return dequant_offset + dequant_scale * vtx_position; }
+#else
+vec3 vertex_position() { return vtx_position; }
+#endif
+
+vec3 oct_decode(vec2 e)
 {
-    // 通过反射关系，从入射/发现求出反射向量
-    // lightdir : 入射向量， 必须是单位向量, 光源 ->反射点
-    // normal :  法线 。  必须是单位向量
-    // 结果：  反射向量
-    Eigen::Vector3f reflect(Eigen::Vector3f lightdir, Eigen::Vector3f normal);
-    // eigen 实现 右手系范围是[-1,1] glm:: perspective 函数，"返回结果.data()" 作为传递uniform的参数
-    // 例子: auto projection = trans::perspective<GLfloat>(...);
-    //       glUniformMatrix4fv(glGetUniformLocation(prog, "projection"), 1, GL_FALSE, projection.data());
-    //
-    // fovy : Field of View,视野，通常设置为45度
-    // aspect： 视口宽高比
-    // near : 就是投影面，其值是投影面距离视点的距离，
-    // far  : 是视景体的后截面，其值是后截面距离视点的距离。far 和 near 的差值，就是视景体的深度。
-    Eigen::Matrix<GLfloat, 4, 4> perspective(GLfloat fovy, GLfloat aspectRatio, GLfloat zNear, GLfloat zFar);
-    //正交变换
-    Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor> ortho(GLfloat left,
-                                                        GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar);
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// columns of the rotation are tangent, bitangent, normal; the sign of w flips the bitangent
+void qtangent_decode(vec4 q, out vec3 t, out vec3 b, out vec3 n)
+{
+    vec4 r = normalize(q);
+    t = vec3(1.0 - 2.0 * (r.y * r.y + r.z * r.z), 2.0 * (r.x * r.y + r.w * r.z), 2.0 * (r.x * r.z - r.w * r.y));
+    b = vec3(2.0 * (r.x * r.y - r.w * r.z), 1.0 - 2.0 * (r.x * r.x + r.z * r.z), 2.0 * (r.y * r.z + r.w * r.x));
+    n = vec3(2.0 * (r.x * r.z + r.w * r.y), 2.0 * (r.y * r.z - r.w * r.x), 1.0 - 2.0 * (r.x * r.x + r.y * r.y));
+    b *= q.w < 0.0 ? -1.0 : 1.0;
+}
+
+#if defined(VTX_TANGENT_QTANGENT)
+layout(location = 3) in vec4 vtx_qtangent;
+#elif defined(VTX_TANGENT_FLOAT3)
+layout(location = 3) in vec3 vtx_tangent;
+layout(location = 4) in vec3 vtx_bitangent;
+#endif
 
-};
+#if defined(VTX_NORMAL_OCT16)
+layout(location = 1) in vec2 vtx_normal;
+vec3 vertex_normal() { return oct_decode(vtx_normal); }
+#elif defined(VTX_NORMAL_INT_2_10_10_10)
+layout(location = 1) in vec4 vtx_normal;
+vec3 vertex_normal() { return normalize(vtx_normal.xyz); }
+#elif defined(VTX_TANGENT_QTANGENT)
+vec3 vertex_normal()
+{
+    vec3 t, b, n;
+    qtangent_decode(vtx_qtangent, t, b, n);
+    return n;
+}
+#else
+layout(location = 1) in vec3 vtx_normal;
+vec3 vertex_normal() { return vtx_normal; }
+#endif
 
-namespace cv
+// every texcoord format is fetched as float
+layout(location = 2) in vec2 vtx_texcoords;
+vec2 vertex_texcoords() { return vtx_texcoords; }
+
+void vertex_tangent_frame(out vec3 t, out vec3 b, out vec3 n)
 {
-    // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
-    enum class Camera_Movement
-    {
-        FORWARD,
-        BACKWARD,
-        LEFT,
-        RIGHT
+#if defined(VTX_TANGENT_QTANGENT)
+    qtangent_decode(vtx_qtangent, t, b, n);
+#elif defined(VTX_TANGENT_FLOAT3)
+    t = vtx_tangent;
+    b = vtx_bitangent;
+    n = vertex_normal();
+#else
+    n = vertex_normal();
+    t = normalize(cross(abs(n.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), n));
+    b = cross(n, t);
+#endif
+}
+)glsl";
+        return text;
     };
 
-    // eye: 在世界坐标中摄像机位置. 眼睛在哪儿
-    // center: 在世界坐标中场景原点. 、看哪儿
-    // up:  在世界坐标中上向量(Up Vector). 头顶朝哪儿
-    //
-    // eigen 实现 glm:: lookAt 函数，"返回结果.data()" 作为传递uniform的参数
-    // 例子: auto view_eigen=trans::lookAt( Eigen::Vector3f(camX, 0.0f, camZ),... );
-    //       glUniformMatrix4fv(glGetUniformLocation(prog, "view"), 1, GL_FALSE,  view_eigen.data());
-    Eigen::Matrix<GLfloat, 4, 4> lookAt(const Eigen::Vector3f &eye,
-                                        const Eigen::Vector3f &center, const Eigen::Vector3f &up);
+    // IEEE half, round to nearest
+    static std::uint16_t float_to_half(float f)
+    {
+        std::uint32_t x;
+        std::memcpy(&x, &f, sizeof(x));
+        std::uint32_t sign = (x >> 16) & 0x8000;
+        std::int32_t exponent = static_cast<std::int32_t>((x >> 23) & 0xff) - 127 + 15;
+        std::uint32_t mantissa = x & 0x7fffff;
+        if (((x >> 23) & 0xff) == 0xff)
+            return static_cast<std::uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+        if (exponent >= 31)
+            return static_cast<std::uint16_t>(sign | 0x7c00);
+        if (exponent <= 0)
+        {
+            // subnormal half
+            if (exponent < -10)
+                return static_cast<std::uint16_t>(sign);
+            mantissa |= 0x800000;
+            std::uint32_t shift = static_cast<std::uint32_t>(14 - exponent);
+            std::uint32_t h = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1)
+                h++;
+            return static_cast<std::uint16_t>(sign | h);
+        }
+        std::uint32_t h = sign | (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000)
+            h++; // a carry into the exponent is still the correctly rounded value
+        return static_cast<std::uint16_t>(h);
+    }
 
-    // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
-    class camera_t
+    static std::int16_t to_snorm16(float v)
     {
-        constexpr static GLfloat YAW = -90.0f;
-        constexpr static GLfloat PITCH = 0.0f;
-        constexpr static GLfloat SPEED = 5.5f;
-        constexpr static GLfloat SENSITIVITY = 0.1f;
-        constexpr static GLfloat ZOOM = 45.0f;
+        return static_cast<std::int16_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f));
+    }
 
-    public:
-        // camera Attributes
-        Eigen::Vector3f Position;
-        Eigen::Vector3f Front;
-        Eigen::Vector3f Up;
-        Eigen::Vector3f Right;
-        Eigen::Vector3f WorldUp;
-        // euler Angles
-        GLfloat Yaw, Pitch; // 是角度值，非弧度值
-        // camera options
-        GLfloat MovementSpeed = SPEED;
-        GLfloat MouseSensitivity = SENSITIVITY;
-        GLfloat Zoom = ZOOM;
+    static std::uint16_t to_unorm16(float v)
+    {
+        return static_cast<std::uint16_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 65535.0f));
+    }
 
-        // constructor with vectors
-        camera_t(Eigen::Vector3f position = Eigen::Vector3f(0.0f, 0.0f, 0.0f),
-                 Eigen::Vector3f up = Eigen::Vector3f(0.0f, 1.0f, 0.0f),
-                 GLfloat yaw = YAW, GLfloat pitch = PITCH);
+    // octahedral mapping of a unit vector onto [-1,1]^2
+    static Eigen::Vector2f oct_encode(Eigen::Vector3f n)
+    {
+        n /= std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+        Eigen::Vector2f e(n.x(), n.y());
+        if (n.z() < 0.0f)
+        {
+            e = Eigen::Vector2f((1.0f - std::abs(n.y())) * (n.x() >= 0.0f ? 1.0f : -1.0f),
+                                (1.0f - std::abs(n.x())) * (n.y() >= 0.0f ? 1.0f : -1.0f));
+        }
+        return e;
+    }
 
-        // returns the view matrix calculated using Euler Angles and the LookAt Matrix
-        Eigen::Matrix<GLfloat, 4, 4> GetViewMatrix();
+    // tangent frame as one quaternion, w is kept away from zero so its sign survives snorm16 and stores the handedness
+    static Eigen::Vector4f qtangent_encode(const Eigen::Vector3f &tangent, const Eigen::Vector3f &bitangent, const Eigen::Vector3f &normal)
+    {
+        Eigen::Vector3f n = normal.norm() > 0.0f ? normal.normalized() : Eigen::Vector3f::UnitZ();
+        Eigen::Vector3f t = tangent - n * n.dot(tangent);
+        if (t.squaredNorm() < 1e-12f)
+            t = n.unitOrthogonal();
+        t.normalize();
+        Eigen::Vector3f b = n.cross(t);
+
+        Eigen::Matrix3f frame;
+        frame << t, b, n;
+        Eigen::Quaternionf q(frame);
+        q.normalize();
+        if (q.w() < 0.0f)
+            q.coeffs() = -q.coeffs();
+
+        const float bias = 1.0f / 32767.0f;
+        if (q.w() < bias)
+        {
+            float s = std::sqrt(1.0f - bias * bias);
+            q.x() *= s;
+            q.y() *= s;
+            q.z() *= s;
+            q.w() = bias;
+        }
+        if (bitangent.dot(b) < 0.0f)
+            q.coeffs() = -q.coeffs();
+        return Eigen::Vector4f(q.x(), q.y(), q.z(), q.w());
+    }
 
-        // processes input received from any keyboard-like input system. Accepts input parameter in the form
-        // of camera defined ENUM (to abstract it from windowing systems)
-        void ProcessKeyboard(Camera_Movement direction, GLfloat deltaTime);
+    meshopt::cacheStats_t meshopt::analyze_vertex_cache(const GLuint *indices, std::size_t count, std::size_t vertex_count,
+                                                        unsigned cache_size)
+    {
+        cacheStats_t stats;
+        if (count < 3)
+            return stats;
+
+        // FIFO: a hit does not refresh the entry, time stamps avoid searching the cache
+        std::vector<std::size_t> stamp(vertex_count, 0);
+        std::vector<char> used(vertex_count, 0);
+        std::size_t time = cache_size + 1, misses = 0, unique = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            GLuint v = indices[i];
+            if (time - stamp[v] > cache_size)
+            {
+                stamp[v] = time++;
+                misses++;
+            }
+            if (used[v] == 0)
+            {
+                used[v] = 1;
+                unique++;
+            }
+        }
+        stats.acmr = static_cast<float>(misses) / static_cast<float>(count / 3);
+        stats.atvr = static_cast<float>(misses) / static_cast<float>(unique);
+        return stats;
+    }
 
-        // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
-        void ProcessMouseMovement(GLfloat xoffset, GLfloat yoffset, GLboolean constrainPitch = true);
+    void meshopt::optimize_vertex_cache(GLuint *indices, std::size_t count, std::size_t vertex_count)
+    {
+        // Tom Forsyth, "Linear-Speed Vertex Cache Optimisation", LRU cache of 32 entries
+        constexpr int cacheSize = 32;
+        const std::size_t faces = count / 3;
+        if (faces < 2)
+            return;
 
-        // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
-        void ProcessMouseScroll(GLfloat yoffset);
+        auto vertex_score = [](int cachePos, unsigned remaining) -> float
+        {
+            if (remaining == 0)
+                return -1.0f;
+            float score = 0.0f;
+            if (cachePos >= 0)
+            {
+                // the vertices of the last triangle get a fixed score, so that it is not simply repeated
+                if (cachePos < 3)
+                    score = 0.75f;
+                else
+                    score = std::pow(1.0f - static_cast<float>(cachePos - 3) / (cacheSize - 3), 1.5f);
+            }
+            // vertices with few triangles left are finished first and leave the cache for good
+            return score + 2.0f / std::sqrt(static_cast<float>(remaining));
+        };
 
-    private:
-        // calculates the front vector from the Camera's (updated) Euler Angles
-        void updateCameraVectors();
-    };
+        // triangles using each vertex, the first remaining[v] entries of a vertex are the ones not emitted yet
+        std::vector<unsigned> remaining(vertex_count, 0), offsets(vertex_count + 1, 0), adjacency(faces * 3);
+        for (std::size_t i = 0; i < faces * 3; i++)
+            remaining[indices[i]]++;
+        for (std::size_t v = 0; v < vertex_count; v++)
+            offsets[v + 1] = offsets[v] + remaining[v];
+        {
+            std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i = 0; i < faces * 3; i++)
+                adjacency[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+        }
 
-};
+        std::vector<int> cachePos(vertex_count, -1);
+        std::vector<float> vscore(vertex_count), tscore(faces);
+        std::vector<char> emitted(faces, 0);
+        for (std::size_t v = 0; v < vertex_count; v++)
+            vscore[v] = vertex_score(-1, remaining[v]);
+        long best = 0;
+        for (std::size_t f = 0; f < faces; f++)
+        {
+            tscore[f] = vscore[indices[f * 3]] + vscore[indices[f * 3 + 1]] + vscore[indices[f * 3 + 2]];
+            if (tscore[f] > tscore[best])
+                best = static_cast<long>(f);
+        }
 
-namespace assimp_helper
-{
-    static inline Eigen::Matrix4f ConvertAiMatrixToEigenFormat(const aiMatrix4x4 &from)
+        std::vector<GLuint> out, cache, next;
+        out.reserve(faces * 3);
+        cache.reserve(cacheSize + 3);
+        next.reserve(cacheSize + 3);
+        std::size_t cursor = 0; // dead ends restart from the first triangle not emitted yet
+        while (out.size() < faces * 3)
+        {
+            if (best < 0)
+            {
+                while (emitted[cursor])
+                    cursor++;
+                best = static_cast<long>(cursor);
+            }
+            emitted[best] = 1;
+            const GLuint *tri = indices + best * 3;
+
+            next.assign(tri, tri + 3);
+            for (auto v : cache)
+            {
+                if (v != tri[0] && v != tri[1] && v != tri[2])
+                    next.push_back(v);
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint v = tri[k];
+                out.push_back(v);
+                auto first = adjacency.begin() + offsets[v], last = first + remaining[v];
+                auto it = std::find(first, last, static_cast<unsigned>(best));
+                std::iter_swap(it, last - 1);
+                remaining[v]--;
+            }
+
+            for (std::size_t i = 0; i < next.size(); i++)
+            {
+                GLuint v = next[i];
+                cachePos[v] = i < cacheSize ? static_cast<int>(i) : -1;
+                vscore[v] = vertex_score(cachePos[v], remaining[v]);
+            }
+            if (next.size() > cacheSize)
+                next.resize(cacheSize);
+            cache.swap(next);
+
+            // only the triangles of cached vertices changed score
+            best = -1;
+            float bestScore = -1.0f;
+            for (auto v : cache)
+            {
+                for (unsigned j = offsets[v]; j < offsets[v] + remaining[v]; j++)
+                {
+                    unsigned f = adjacency[j];
+                    tscore[f] = vscore[indices[f * 3]] + vscore[indices[f * 3 + 1]] + vscore[indices[f * 3 + 2]];
+                    if (tscore[f] > bestScore)
+                    {
+                        bestScore = tscore[f];
+                        best = f;
+                    }
+                }
+            }
+        }
+        std::copy(out.begin(), out.end(), indices);
+    }
+
+    bool meshopt::optimize_overdraw(GLuint *indices, std::size_t count, const GLfloat *positions, std::size_t position_stride,
+                                    std::size_t vertex_count, float threshold)
     {
-        Eigen::Matrix4f to;
-        //the a,b,c,d in assimp is the row ; the 1,2,3,4 is the column
-        to << from.a1, from.a2, from.a3, from.a4,
-            from.b1, from.b2, from.b3, from.b4,
-            from.c1, from.c2, from.c3, from.c4,
-            from.d1, from.d2, from.d3, from.d4;
-        return to;
+        // Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+        const std::size_t faces = count / 3;
+        if (faces < 2)
+            return false;
+        auto pos = [&](GLuint v)
+        {
+            return Eigen::Map<const Eigen::Vector3f>(reinterpret_cast<const GLfloat *>(
+                reinterpret_cast<const unsigned char *>(positions) + v * position_stride));
+        };
+
+        // clusters start where the cache runs cold, reordering them costs little vertex reuse
+        std::vector<std::size_t> starts{0};
+        {
+            constexpr std::size_t cacheSize = 16;
+            std::vector<std::size_t> stamp(vertex_count, 0);
+            std::size_t time = cacheSize + 1;
+            for (std::size_t f = 0; f < faces; f++)
+            {
+                int misses = 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    GLuint v = indices[f * 3 + k];
+                    if (time - stamp[v] > cacheSize)
+                    {
+                        stamp[v] = time++;
+                        misses++;
+                    }
+                }
+                if (misses == 3 && f > starts.back())
+                    starts.push_back(f);
+            }
+        }
+        if (starts.size() < 2)
+            return false;
+        starts.push_back(faces);
+
+        struct cluster_t
+        {
+            std::size_t begin, end;
+            Eigen::Vector3f centroid, normal;
+            float area;
+        };
+        std::vector<cluster_t> clusters;
+        Eigen::Vector3f meshCentroid = Eigen::Vector3f::Zero();
+        float meshArea = 0.0f;
+        for (std::size_t c = 0; c + 1 < starts.size(); c++)
+        {
+            cluster_t cl{starts[c], starts[c + 1], Eigen::Vector3f::Zero(), Eigen::Vector3f::Zero(), 0.0f};
+            for (std::size_t f = cl.begin; f < cl.end; f++)
+            {
+                Eigen::Vector3f a = pos(indices[f * 3]), b = pos(indices[f * 3 + 1]), d = pos(indices[f * 3 + 2]);
+                Eigen::Vector3f n = (b - a).cross(d - a);
+                float area = n.norm();
+                cl.normal += n;
+                cl.centroid += (a + b + d) * (area / 3.0f);
+                cl.area += area;
+            }
+            meshCentroid += cl.centroid;
+            meshArea += cl.area;
+            if (cl.area > 0.0f)
+                cl.centroid /= cl.area;
+            clusters.push_back(cl);
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        // clusters facing away from the centre are likely in front of the others, draw them first
+        std::vector<float> key(clusters.size());
+        for (std::size_t c = 0; c < clusters.size(); c++)
+        {
+            float len = clusters[c].normal.norm();
+            key[c] = len > 0.0f ? (clusters[c].centroid - meshCentroid).dot(clusters[c].normal / len) : 0.0f;
+        }
+        std::vector<std::size_t> order(clusters.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                         { return key[a] > key[b]; });
+
+        std::vector<GLuint> sorted;
+        sorted.reserve(faces * 3);
+        for (auto c : order)
+            sorted.insert(sorted.end(), indices + clusters[c].begin * 3, indices + clusters[c].end * 3);
+
+        auto before = analyze_vertex_cache(indices, faces * 3, vertex_count);
+        auto after = analyze_vertex_cache(sorted.data(), sorted.size(), vertex_count);
+        if (after.acmr > before.acmr * threshold)
+            return false;
+        std::copy(sorted.begin(), sorted.end(), indices);
+        return true;
     }
 
-};
+    std::size_t meshopt::optimize_vertex_fetch(void *vertices, std::size_t vertex_count, std::size_t stride,
+                                               GLuint *indices, std::size_t count)
+    {
+        constexpr GLuint unused = std::numeric_limits<GLuint>::max();
+        std::vector<GLuint> remap(vertex_count, unused);
+        GLuint next = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            GLuint &r = remap[indices[i]];
+            if (r == unused)
+                r = next++;
+            indices[i] = r;
+        }
+
+        auto data = static_cast<unsigned char *>(vertices);
+        std::vector<unsigned char> copy(data, data + vertex_count * stride);
+        for (std::size_t v = 0; v < vertex_count; v++)
+        {
+            if (remap[v] != unused)
+                std::memcpy(data + remap[v] * stride, copy.data() + v * stride, stride);
+        }
+        return next;
+    }
+
+    meshopt::report_t meshopt::optimize(void *vertices, std::size_t &vertex_count, std::size_t stride,
+                                        std::ptrdiff_t position_offset, std::vector<GLuint> &indices)
+    {
+        report_t report;
+        if (indices.size() < 3 || indices.size() % 3 != 0)
+            return report;
+        if (std::any_of(indices.begin(), indices.end(), [&](GLuint i)
+                        { return i >= vertex_count; }))
+            return report;
+
+        report.triangles = indices.size() / 3;
+        report.before = analyze_vertex_cache(indices.data(), indices.size(), vertex_count);
+        optimize_vertex_cache(indices.data(), indices.size(), vertex_count);
+        if (position_offset >= 0)
+        {
+            auto positions = reinterpret_cast<const GLfloat *>(static_cast<unsigned char *>(vertices) + position_offset);
+            report.overdraw = optimize_overdraw(indices.data(), indices.size(), positions, stride, vertex_count);
+        }
+        auto unique = optimize_vertex_fetch(vertices, vertex_count, stride, indices.data(), indices.size());
+        report.vertices_dropped = vertex_count - unique;
+        vertex_count = unique;
+        report.after = analyze_vertex_cache(indices.data(), indices.size(), vertex_count);
+        return report;
+    }
+
+    meshopt::weldReport_t meshopt::weld(const void *vertices, std::size_t vertex_count, std::size_t stride,
+                                        const vertexFormat_t::attrib_t *attribs, std::size_t nattribs, float epsilon,
+                                        std::vector<unsigned char> &unique, std::vector<GLuint> &remap)
+    {
+        weldReport_t report;
+        report.input = vertex_count;
+        auto data = static_cast<const unsigned char *>(vertices);
+
+        std::vector<std::pair<std::size_t, GLint>> fields; // byte offset, float components
+        for (std::size_t a = 0; a < nattribs; a++)
+        {
+            if (attribs[a].type == GL_FLOAT)
+                fields.emplace_back(attribs[a].offset, attribs[a].size);
+        }
+        // the quantized components decide equality, the hash only narrows the candidates
+        auto quantize = [epsilon](float v) -> std::int64_t
+        {
+            if (epsilon > 0.0f)
+                return std::llround(static_cast<double>(v) / epsilon);
+            std::int32_t bits;
+            v = v == 0.0f ? 0.0f : v; // -0 == 0
+            std::memcpy(&bits, &v, sizeof(bits));
+            return bits;
+        };
+        auto equal = [&](std::size_t x, std::size_t y)
+        {
+            for (auto &f : fields)
+            {
+                auto px = reinterpret_cast<const GLfloat *>(data + x * stride + f.first);
+                auto py = reinterpret_cast<const GLfloat *>(data + y * stride + f.first);
+                for (GLint c = 0; c < f.second; c++)
+                {
+                    if (quantize(px[c]) != quantize(py[c]))
+                        return false;
+                }
+            }
+            return true;
+        };
+
+        auto &pool = threadPool_t::instance();
+        std::vector<std::uint64_t> hashes(vertex_count);
+        pool.parallel_for(vertex_count, [&](std::size_t begin, std::size_t end)
+                          {
+                              for (std::size_t i = begin; i < end; i++)
+                              {
+                                  std::uint64_t h = 14695981039346656037ull; // fnv1a offset basis
+                                  for (auto &f : fields)
+                                  {
+                                      auto p = reinterpret_cast<const GLfloat *>(data + i * stride + f.first);
+                                      for (GLint c = 0; c < f.second; c++)
+                                      {
+                                          auto q = quantize(p[c]);
+                                          h = fnv1a(&q, sizeof(q), h);
+                                      }
+                                  }
+                                  hashes[i] = h;
+                              } });
+
+        // the hash space is split into partitions, each one resolves its vertices in input order
+        // so the representative of a group is always its first vertex
+        const std::size_t partitions = vertex_count < 65536 ? 1 : pool.size() + 1;
+        constexpr GLuint none = std::numeric_limits<GLuint>::max();
+        // bucket the vertices by partition in one pass (counting sort, stable: every bucket stays in input order)
+        std::vector<std::size_t> starts(partitions + 1, 0);
+        for (std::size_t i = 0; i < vertex_count; i++)
+            starts[hashes[i] % partitions + 1]++;
+        std::partial_sum(starts.begin(), starts.end(), starts.begin());
+        std::vector<GLuint> order(vertex_count);
+        {
+            auto fill = starts;
+            for (std::size_t i = 0; i < vertex_count; i++)
+                order[fill[hashes[i] % partitions]++] = static_cast<GLuint>(i);
+        }
+
+        std::vector<GLuint> rep(vertex_count), next(vertex_count, none);
+        pool.parallel_for(partitions, [&](std::size_t begin, std::size_t end)
+                          {
+                              for (std::size_t part = begin; part < end; part++)
+                              {
+                                  // open addressing, linear probing: the first vertex of each hash, like uniformTable_t
+                                  const std::size_t members = starts[part + 1] - starts[part];
+                                  std::size_t capacity = 16;
+                                  while (capacity < members * 2)
+                                      capacity *= 2;
+                                  std::vector<GLuint> heads(capacity, none);
+
+                                  for (std::size_t k = starts[part]; k < starts[part + 1]; k++)
+                                  {
+                                      const GLuint i = order[k];
+                                      rep[i] = i;
+                                      // the low bits select the partition, probe with the high ones
+                                      std::size_t slot = (hashes[i] >> 32) & (capacity - 1);
+                                      while (heads[slot] != none && hashes[heads[slot]] != hashes[i])
+                                          slot = (slot + 1) & (capacity - 1);
+                                      if (heads[slot] == none)
+                                      {
+                                          heads[slot] = i;
+                                          continue;
+                                      }
+                                      // walk the representatives with this hash, chained through next
+                                      GLuint r = heads[slot], last = r;
+                                      for (; r != none; last = r, r = next[r])
+                                      {
+                                          if (equal(r, i))
+                                              break;
+                                      }
+                                      if (r != none)
+                                          rep[i] = r;
+                                      else
+                                          next[last] = i;
+                                  }
+                              } },
+                          1);
+
+        remap.resize(vertex_count);
+        unique.clear();
+        unique.reserve(vertex_count * stride);
+        GLuint count = 0;
+        for (std::size_t i = 0; i < vertex_count; i++)
+        {
+            if (rep[i] == i)
+            {
+                remap[i] = count++;
+                unique.insert(unique.end(), data + i * stride, data + (i + 1) * stride);
+            }
+            else
+            {
+                remap[i] = remap[rep[i]];
+            }
+        }
+        unique.shrink_to_fit();
+        report.output = count;
+        return report;
+    }
+
+    threadPool_t &threadPool_t::instance()
+    {
+        static threadPool_t pool;
+        return pool;
+    };
 
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-/////////////////////////////////////////////////////////////////////////////////////////////////////
-#if defined(MYGLUTILITY__IMPLEMENTATION) 
+    threadPool_t::threadPool_t()
+    {
+        // workers push into the upload queue: constructed first, it is destroyed after the pool has joined them
+        uploadQueue_t::instance();
+        this->start();
+    }
 
-// Eigen::MatrixXd
-namespace shaders
-{
-    bool prog_t::use()
+    threadPool_t::~threadPool_t()
     {
-        if (this->progid == 0)
-            return false;
+        this->shutdown();
+    }
 
-        glUseProgram(this->progid);
-        return true;
-    };
+    void threadPool_t::start()
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_stop = false;
+        unsigned n = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned i = 0; i < n; i++)
+            this->m_workers.emplace_back(&threadPool_t::run, this);
+    }
 
-    bool prog_t::loadFromPath(const std::filesystem::path &vert_path, const std::filesystem::path &frag_path)
+    void threadPool_t::stop()
     {
-        // reload, delete previous
-        if (this->progid != 0)
+        std::deque<std::function<void()>> dropped;
         {
-            glDeleteProgram(this->progid);
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_stop = true;
+            dropped.swap(this->m_tasks);
         }
+        this->m_wake.notify_all();
+        for (auto &t : this->m_workers)
+            t.join();
+        // helpers a running parallel_for queued meanwhile are not needed, its caller does all the ranges itself
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_workers.clear();
+        this->m_tasks.clear();
+    }
 
-        auto v_str = readShader_fromfile(vert_path);
-        if (v_str.size() == 0)
-            return false;
-        auto f_str = readShader_fromfile(frag_path);
-        if (v_str.size() == 0)
-            return false;
+    void threadPool_t::cancel()
+    {
+        this->stop();
+        if (this->m_shutdown == false)
+            this->start();
+    }
 
-        return load(v_str, f_str);
-    };
-    bool prog_t::load(const std::string &vert_content, const std::string &frag_content)
+    void threadPool_t::shutdown()
     {
-        this->progid = create_link_program(vert_content, frag_content);
-        if (this->progid == 0)
-            return false;
+        this->m_shutdown = true;
+        this->stop();
+    }
 
-        return true;
-    };
+    void threadPool_t::run()
+    {
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(this->m_mutex);
+                this->m_wake.wait(lock, [this]
+                                  { return this->m_stop || this->m_tasks.empty() == false; });
+                if (this->m_tasks.empty())
+                    return;
+                task = std::move(this->m_tasks.front());
+                this->m_tasks.pop_front();
+            }
+            task();
+        }
+    }
 
-    GLuint prog_t::create_link_program(std::string vert_glsl, std::string frag_glsl)
+    std::future<void> threadPool_t::submit(std::function<void()> task)
     {
-        //helper
-        struct _shaderInfo
+        // std::function needs a copyable target, packaged_task is move-only
+        auto job = std::make_shared<std::packaged_task<void()>>(std::move(task));
+        auto done = job->get_future();
+        bool queued;
         {
-            GLenum type;
-            std::string shaderstr;
-            GLuint shader;
-        };
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            queued = this->m_stop == false;
+            if (queued)
+                this->m_tasks.emplace_back([job]
+                                           { (*job)(); });
+        }
+        // no workers while stopped, the caller runs it
+        if (queued)
+            this->m_wake.notify_one();
+        else
+            (*job)();
+        return done;
+    }
 
-        auto LoadShaders = [](std::vector<_shaderInfo> &shaders) -> GLuint
+    void threadPool_t::parallel_for(std::size_t n, const std::function<void(std::size_t, std::size_t)> &body, std::size_t grain)
+    {
+        grain = std::max<std::size_t>(grain, 1);
+        const std::size_t ranges = (n + grain - 1) / grain;
+        bool alone;
         {
-            if (shaders.empty() == true)
-                return 0;
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            alone = this->m_stop || this->m_workers.empty();
+        }
+        if (ranges <= 1 || alone)
+        {
+            if (n > 0)
+                body(0, n);
+            return;
+        }
 
-            for (auto iter = shaders.begin(); iter != shaders.end(); iter++)
+        // helpers that start after all ranges are taken return without touching body
+        struct state_t
+        {
+            std::atomic<std::size_t> next{0};
+            std::atomic<bool> failed{false};
+            std::size_t done = 0;
+            std::exception_ptr error; // the first exception thrown by body
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<state_t>();
+        auto work = [state, ranges, n, grain, &body]
+        {
+            std::size_t r, count = 0;
+            while ((r = state->next.fetch_add(1)) < ranges)
             {
-                if (iter->type == GL_NONE)
-                    continue;
-                iter->shader = glCreateShader(iter->type);
-                // const GLchar *source = entry->shaderstr.data();
-                auto source = iter->shaderstr.c_str();
-                glShaderSource(iter->shader, 1, &source, NULL);
-                glCompileShader(iter->shader);
-
-                // check for shader compile errors
-                GLint success;
-                glGetShaderiv(iter->shader, GL_COMPILE_STATUS, &success);
-                if (!success)
+                // after a failure the remaining ranges are skipped but still counted, the caller waits for all of them
+                if (state->failed == false)
                 {
-                    // if constexpr (is_debug == true)
+                    try
                     {
-                        GLsizei len;
-                        glGetShaderiv(iter->shader, GL_INFO_LOG_LENGTH, &len);
-
-                        GLchar *log = new GLchar[len + 1];
-                        glGetShaderInfoLog(iter->shader, len, &len, log);
-                        std::cerr << "Shader compilation failed: " << log << std::endl;
-                        delete[] log;
+                        body(r * grain, std::min(n, (r + 1) * grain));
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        if (state->error == nullptr)
+                            state->error = std::current_exception();
+                        state->failed = true;
                     }
-
-                    return 0;
                 }
+                count++;
             }
-
-            GLuint prog = glCreateProgram();
-            if (prog == 0)
-            {
-                std::cout << "glCreateProgram fail. " << __func__ << std::endl;
-                return 0;
-            }
-            for (auto iter = shaders.begin(); iter != shaders.end(); iter++)
+            if (count > 0)
             {
-                // attach shaders
-                glAttachShader(prog, iter->shader);
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->done += count;
+                if (state->done == ranges)
+                    state->finished.notify_all();
             }
-            // link shaders
-            glLinkProgram(prog);
+        };
 
-            // check for linking errors
-            GLint linked;
-            glGetProgramiv(prog, GL_LINK_STATUS, &linked);
-            if (!linked)
-            {
-                // if constexpr (is_debug == true)
-                {
-                    GLsizei len;
-                    glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &len);
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            for (std::size_t i = 0, helpers = std::min(ranges - 1, this->m_workers.size()); i < helpers; i++)
+                this->m_tasks.emplace_back(work);
+        }
+        this->m_wake.notify_all();
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&]
+                             { return state->done == ranges; });
+        // no helper touches body any more, so it is safe to leave
+        if (state->error != nullptr)
+            std::rethrow_exception(state->error);
+    }
 
-                    GLchar *log = new GLchar[len + 1];
-                    glGetProgramInfoLog(prog, len, &len, log);
-                    std::cerr << "Shader linking failed: " << log << std::endl;
-                    delete[] log;
-                }
-                return 0;
-            }
-            //在把着色器对象链接到程序对象以后，记得删除着色器对象，我们不再需要它们了
-            for (auto j = shaders.begin(); j != shaders.end() && j->type != GL_NONE; j++)
+    uploadQueue_t &uploadQueue_t::instance()
+    {
+        static uploadQueue_t queue;
+        return queue;
+    };
+
+    uploadQueue_t::~uploadQueue_t()
+    {
+        // without shutdown() the context is most likely gone: leak what the tasks hold rather than call GL without it
+        if (this->m_tasks.empty() == false)
+            new std::deque<std::function<void()>>(std::move(this->m_tasks));
+    }
+
+    bool uploadQueue_t::push(std::function<void()> task)
+    {
+        // after shutdown the task is dropped, it is released when task goes out of scope, outside the lock
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        if (this->m_closed)
+            return false;
+        this->m_tasks.push_back(std::move(task));
+        return true;
+    }
+
+    std::size_t uploadQueue_t::drain(std::chrono::steady_clock::duration budget)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + budget;
+        std::size_t run = 0;
+        do
+        {
+            std::function<void()> task;
             {
-                glDeleteShader(j->shader);
-                j->shader = 0;
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                if (this->m_tasks.empty())
+                    break;
+                task = std::move(this->m_tasks.front());
+                this->m_tasks.pop_front();
             }
+            // outside the lock, a task may push follow-up work
+            task();
+            run++;
+        } while (std::chrono::steady_clock::now() < deadline);
+        return run;
+    }
 
-            return prog;
-        };
+    std::size_t uploadQueue_t::pending() const
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_tasks.size();
+    }
 
-        auto shaders = std::vector<_shaderInfo>{
-            {GL_VERTEX_SHADER, vert_glsl}, {GL_FRAGMENT_SHADER, frag_glsl}};
+    void uploadQueue_t::cancel()
+    {
+        this->drop(false);
+    }
 
-        GLuint program = LoadShaders(shaders);
-        return program;
-    };
-    void prog_t::del_program()
+    void uploadQueue_t::shutdown()
     {
-        glDeleteProgram(this->progid);
-    };
+        this->drop(true);
+    }
 
-    std::basic_string<GLchar> prog_t::readShader_fromfile(const std::filesystem::path &_path)
+    bool uploadQueue_t::closed() const
     {
-        std::basic_string<GLchar> out;
-        std::ifstream file(_path);
-        if (file.fail())
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return this->m_closed;
+    }
+
+    void uploadQueue_t::drop(bool close)
+    {
+        // running pool tasks may still push here, so the pool goes first; what it dropped is destroyed on this thread too
+        auto &pool = threadPool_t::instance();
+        if (close)
+            pool.shutdown();
+        else
+            pool.cancel();
+        std::deque<std::function<void()>> cancelled;
         {
-            return out;
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_closed = this->m_closed || close;
+            cancelled.swap(this->m_tasks);
+            this->m_generation++;
         }
+        // the closures release their PBOs and buffers here, with the context current
+        cancelled.clear();
+    }
 
-        std::ostringstream oss;
-        oss << file.rdbuf();
-        out = oss.str();
-        file.close();
+    // constructor
+    mesh_t::mesh_t(std::vector<vertex_t> _vertices, std::vector<GLuint> _indices, std::vector<texture_t> _textures,
+                   const vertexFormat_t &_format)
+    {
+        this->vertices = std::move(_vertices);
+        this->indices = std::move(_indices);
+        this->textures = std::move(_textures);
+        this->nameSamplers();
 
-        return out;
-    };
+        // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        auto staged = this->stage(_format);
+        this->upload(staged.vertices.data(), static_cast<GLsizeiptr>(staged.vertices.size()),
+                     staged.indices.data(), static_cast<GLsizeiptr>(staged.indices.size()));
+    }
 
-};
+    mesh_t::staged_t mesh_t::stage(const vertexFormat_t &format)
+    {
+        this->m_format = format;
+        this->m_attribs = format.attribs();
+        this->m_stride = format.stride();
+        this->m_vertexCount = this->vertices.size();
+
+        staged_t staged;
+        staged.vertices = this->pack();
+        // 16-bit whenever possible, half the index memory and bandwidth
+        staged.indices = this->encode_indices();
+        this->m_indexCount = this->indices.size();
+        return staged;
+    }
 
-namespace trans
-{
-    // 通过反射关系，从入射/发现求出反射向量
-    // lightdir : 入射向量， 必须是单位向量, 光源 ->反射点
-    // normal :  法线 。  必须是单位向量
-    // 结果：  反射向量
-    Eigen::Vector3f reflect(Eigen::Vector3f lightdir, Eigen::Vector3f normal) //得到反射方向
+    mesh_t::mesh_t(const void *_interleaved, std::size_t _count, GLsizei _stride,
+                   const vertexFormat_t::attrib_t *_attribs, std::size_t _nattribs,
+                   std::vector<GLuint> _indices, std::vector<texture_t> _textures)
     {
-        // L     N     R
-        //       |
-        //      /|
-        //  \  / |    /
-        //   \/  |   /
-        //    \  |  /
-        //     \ | /
-        // -----\|/----------------------
-        // 构造菱形
-        lightdir = -lightdir;
-        Eigen::Vector3f result;
-        auto cos_theta = lightdir.dot(normal);
-        result = (2 * cos_theta * normal - lightdir);
-        result.normalize();
-        return result;
+        this->indices = std::move(_indices);
+        this->textures = std::move(_textures);
+        this->m_attribs.assign(_attribs, _attribs + _nattribs);
+        this->m_stride = _stride;
+        this->m_vertexCount = _count;
+        this->nameSamplers();
+
+        setupMesh(_interleaved, static_cast<GLsizeiptr>(_count) * _stride);
     }
 
-    // eigen 实现 右手系范围是[-1,1] glm:: perspective 函数，"返回结果.data()" 作为传递uniform的参数
-    // 例子: auto projection = trans::perspective<GLfloat>(...);
-    //       glUniformMatrix4fv(glGetUniformLocation(prog, "projection"), 1, GL_FALSE, projection.data());
-    //
-    // fovy : Field of View,视野，通常设置为45度
-    // aspect： 视口宽高比
-    // near : 就是投影面，其值是投影面距离视点的距离，
-    // far  : 是视景体的后截面，其值是后截面距离视点的距离。far 和 near 的差值，就是视景体的深度。
-    Eigen::Matrix<GLfloat, 4, 4> perspective(GLfloat fovy, GLfloat aspectRatio, GLfloat zNear, GLfloat zFar)
+    void mesh_t::nameSamplers()
     {
-        Eigen::Matrix<GLfloat, 4, 4> Result;
-        //[formula](http://openglbook.com/the-book/chapter-4-entering-the-third-dimension/)
+        // retrieve texture number (the N in diffuse_textureN)
+        GLuint diffuseNr = 1;
+        GLuint specularNr = 1;
+        GLuint normalNr = 1;
+        GLuint heightNr = 1;
+        for (auto &t : this->textures)
+        {
+            std::string number;
+            const std::string &name = t.type;
+            if (name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if (name == "texture_specular")
+                number = std::to_string(specularNr++); // transfer unsigned int to stream
+            else if (name == "texture_normal")
+                number = std::to_string(normalNr++); // transfer unsigned int to stream
+            else if (name == "texture_height")
+                number = std::to_string(heightNr++); // transfer unsigned int to stream
+            this->m_samplerNames.push_back(name + number);
+        }
+    }
 
-        //     [ xScale   0                 0                        0               ]
-        // P = [   0    yScale              0                        0               ]
-        //     [   0      0    -(zFar+zNear)/(zFar-zNear) -2*zNear*zFar/(zFar-zNear) ]
-        //     [   0      0                -1                        0               ]
-        // yScale = cot(fovY/2)
-        // xScale = yScale/aspectRatio
-        auto yScale = 1.0f / std::tan(fovy / 2.0f);
-        auto xScale = yScale / aspectRatio;
-        Result << xScale, 0, 0, 0,
-            0, yScale, 0, 0,
-            0, 0, -(zFar + zNear) / (zFar - zNear), -2 * zNear * zFar / (zFar - zNear),
-            0, 0, -1, 0;
-        return Result;
+    // render the mesh
+    void mesh_t::Draw(shaders::prog_t &shader)
+    {
+        this->bind_material(shader);
 
-        // GLfloat const tanHalfFovy = std::tan(fovy / 2.0f);
-        // Result = Eigen::Matrix<GLfloat, 4, 4>::Zero();
-        // Result(0, 0) = 1.0f / (aspect * tanHalfFovy);
-        // Result(1, 1) = 1.0f / (tanHalfFovy);
-        // Result(2, 2) = -(zFar + zNear) / (zFar - zNear);
-        // Result(2, 3) = -1.0f;
-        // Result(3, 2) = -(2.0f * zFar * zNear) / (zFar - zNear);
-        // return Result.transpose();
-    };
-    //正交变换
-    Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor> ortho(GLfloat left, GLfloat right, GLfloat bottom, GLfloat top, GLfloat zNear, GLfloat zFar)
+        // draw mesh
+        glBindVertexArray(this->m_drawVao);
+        this->submit();
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void mesh_t::bind_material(shaders::prog_t &shader)
     {
-        Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor> Result;
-        Result = Eigen::Matrix<GLfloat, 4, 4, Eigen::RowMajor>::Identity();
-        Result(0, 0) = 2.0f / (right - left);
-        Result(1, 1) = 2.0f / (top - bottom);
-        Result(2, 2) = -2.0f / (zFar - zNear);
-        Result(0, 3) = -(right + left) / (right - left);
-        Result(1, 3) = -(top + bottom) / (top - bottom);
-        Result(2, 3) = -(zFar + zNear) / (zFar - zNear);
-        return Result;
-    };
+        // bind appropriate textures
+        for (unsigned int i = 0; i < this->textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+
+            // now set the sampler to the correct texture unit
+            shader.uniform_set<GLint>(shader.uniform_location(this->m_samplerNames[i]), i);
+            // and finally bind the texture
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        }
+        if (this->m_format.position == vertexFormat_t::position_t::QUANT16)
+        {
+            shader.uniform_set<Eigen::Vector3f>(shader.uniform_location("dequant_scale"), this->m_dequantScale);
+            shader.uniform_set<Eigen::Vector3f>(shader.uniform_location("dequant_offset"), this->m_dequantOffset);
+        }
+    }
+
+    std::size_t mesh_t::submit_instanced(GLsizei instances)
+    {
+        if (this->m_indexCount == 0)
+        {
+            glDrawArraysInstanced(GL_TRIANGLES, this->m_baseVertex, this->m_vertexCount, instances);
+            return 1;
+        }
+        for (auto &c : this->m_chunks)
+        {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, c.count, this->m_indexType,
+                                              (void *)(std::uintptr_t)(this->m_firstIndex + c.firstIndex), instances,
+                                              this->m_baseVertex + c.baseVertex);
+        }
+        return this->m_chunks.size();
+    }
+
+    std::size_t mesh_t::submit()
+    {
+        if (this->m_indexCount == 0)
+        {
+            glDrawArrays(GL_TRIANGLES, this->m_baseVertex, this->m_vertexCount);
+            return 1;
+        }
+        for (auto &c : this->m_chunks)
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, c.count, this->m_indexType,
+                                     (void *)(std::uintptr_t)(this->m_firstIndex + c.firstIndex), this->m_baseVertex + c.baseVertex);
+        }
+        return this->m_chunks.size();
+    }
+
+    std::vector<unsigned char> mesh_t::encode_indices()
+    {
+        constexpr std::size_t range = std::numeric_limits<GLushort>::max() + std::size_t(1);
+        this->m_chunks.clear();
+        this->m_indexType = GL_UNSIGNED_INT;
+        const auto count = this->indices.size();
+        if (count == 0)
+            return {};
+
+        auto as_bytes = [](const auto *data, std::size_t n)
+        {
+            auto p = reinterpret_cast<const unsigned char *>(data);
+            return std::vector<unsigned char>(p, p + n * sizeof(*data));
+        };
+        auto wide = [&]()
+        {
+            this->m_chunks.assign(1, {static_cast<GLsizei>(count), 0, 0});
+            this->m_indexType = GL_UNSIGNED_INT;
+            return as_bytes(this->indices.data(), count);
+        };
+
+        // split at triangle boundaries into runs that address less than `range` vertices each
+        struct run_t
+        {
+            std::size_t begin, end;
+            GLuint lo, hi;
+        };
+        std::vector<run_t> runs;
+        if (this->m_vertexCount <= range)
+        {
+            runs.push_back({0, count, 0, 0});
+        }
+        else
+        {
+            if (count % 3 != 0)
+                return wide();
+            for (std::size_t i = 0; i < count; i += 3)
+            {
+                auto tri = this->indices.data() + i;
+                GLuint lo = std::min({tri[0], tri[1], tri[2]}), hi = std::max({tri[0], tri[1], tri[2]});
+                if (hi - lo >= range)
+                    return wide();
+                if (runs.empty() || std::max(hi, runs.back().hi) - std::min(lo, runs.back().lo) >= range)
+                    runs.push_back({i, i, lo, hi});
+                auto &r = runs.back();
+                r.end = i + 3;
+                r.lo = std::min(lo, r.lo);
+                r.hi = std::max(hi, r.hi);
+            }
+            // every extra chunk is a draw call, not worth it for scattered indices
+            if (count / 3 / runs.size() < 1024)
+                return wide();
+        }
 
-};
+        std::vector<GLushort> narrow(count);
+        for (auto &r : runs)
+        {
+            for (std::size_t i = r.begin; i < r.end; i++)
+                narrow[i] = static_cast<GLushort>(this->indices[i] - r.lo);
+            this->m_chunks.push_back({static_cast<GLsizei>(r.end - r.begin),
+                                      static_cast<GLsizeiptr>(r.begin * sizeof(GLushort)), static_cast<GLint>(r.lo)});
+        }
+        this->m_indexType = GL_UNSIGNED_SHORT;
+        return as_bytes(narrow.data(), count);
+    }
 
-namespace cv
-{
-    // eye: 在世界坐标中摄像机位置. 眼睛在哪儿
-    // center: 在世界坐标中场景原点. 、看哪儿
-    // up:  在世界坐标中上向量(Up Vector). 头顶朝哪儿
-    //
-    // eigen 实现 glm:: lookAt 函数，"返回结果.data()" 作为传递uniform的参数
-    // 例子: auto view_eigen=trans::lookAt( Eigen::Vector3f(camX, 0.0f, camZ),... );
-    //       glUniformMatrix4fv(glGetUniformLocation(prog, "view"), 1, GL_FALSE,  view_eigen.data());
-    Eigen::Matrix<GLfloat, 4, 4> lookAt(const Eigen::Vector3f &eye, const Eigen::Vector3f &center, const Eigen::Vector3f &up)
+    // initializes all the buffer objects/arrays
+    void mesh_t::setupMesh(const void *data, GLsizeiptr bytes)
     {
-        // 得到相机坐标系(u-v-n) ,该坐标系是左手坐标系统。而opgen相机坐标系是右手系
-        Eigen::Vector3f n(center - eye); // n 代表 opgen相机坐标系"+Z轴"反向
-        n.normalize();
+        // 16-bit whenever possible, half the index memory and bandwidth
+        auto encoded = this->encode_indices();
+        this->m_indexCount = this->indices.size();
+        this->upload(data, bytes, encoded.data(), static_cast<GLsizeiptr>(encoded.size()));
+    }
 
-        Eigen::Vector3f u(n.cross(up)); // u 代表 opgen相机坐标系"+X轴"
-        u.normalize();
+    void mesh_t::upload(const void *data, GLsizeiptr bytes, const void *indexData, GLsizeiptr indexBytes)
+    {
+        // create buffers/arrays
+        this->VAO = glVertexArray_t::create();
+        this->m_drawVao = this->VAO;
+        this->VBO = glBuffer_t::create();
+        this->EBO = glBuffer_t::create();
 
-        Eigen::Vector3f v(u.cross(n)); //  v 代表 opgen相机坐标系"+Y轴"
-        v.normalize();
+        glBindVertexArray(this->VAO);
+        // load data into vertex buffers
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
 
-        Eigen::Matrix<GLfloat, 4, 4> Result;
-        Result << u.x(), u.y(), u.z(), -u.dot(eye),
-            v.x(), v.y(), v.z(), -v.dot(eye),
-            -n.x(), -n.y(), -n.z(), n.dot(eye),
-            0, 0, 0, 1;
-        return Result;
-    };
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
 
-    // constructor with vectors
-    camera_t::camera_t(Eigen::Vector3f position,
-                       Eigen::Vector3f up,
-                       GLfloat yaw, GLfloat pitch)
-    {
-        Front = Eigen::Vector3f(0.0f, 0.0f, -1.0f);
-        Position = position;
+        // set the vertex attribute pointers, locations 0..4 as documented in model_t; absent attributes stay disabled
+        for (auto &a : this->m_attribs)
+        {
+            glEnableVertexAttribArray(a.location);
+            glVertexAttribPointer(a.location, a.size, a.type, a.normalized, this->m_stride, (void *)(std::uintptr_t)a.offset);
+        }
 
-        WorldUp = up;
-        Yaw = yaw;
-        Pitch = pitch;
-        updateCameraVectors();
+        glBindVertexArray(0);
     }
 
-    // returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    Eigen::Matrix<GLfloat, 4, 4> camera_t::GetViewMatrix()
+    std::size_t mesh_t::apply_residency(residency_t policy)
     {
-        return lookAt(Position, Eigen::Vector3f(Position + Front), Up);
-    };
+        if (policy == residency_t::KEEP)
+            return 0;
 
-    // processes input received from any keyboard-like input system. Accepts input parameter in the form
-    // of camera defined ENUM (to abstract it from windowing systems)
-    void camera_t::ProcessKeyboard(Camera_Movement direction, GLfloat deltaTime)
+        std::size_t before = this->vertices.capacity() * sizeof(vertex_t) + this->indices.capacity() * sizeof(GLuint) +
+                             this->positions.capacity() * sizeof(Eigen::Vector3f);
+        if (policy == residency_t::POSITIONS && this->vertices.empty() == false)
+        {
+            this->positions.clear();
+            this->positions.reserve(this->vertices.size());
+            for (auto &v : this->vertices)
+                this->positions.push_back(v.Position);
+        }
+        if (policy == residency_t::DROP)
+        {
+            std::vector<GLuint>().swap(this->indices);
+            std::vector<Eigen::Vector3f>().swap(this->positions);
+        }
+        // swap with an empty vector, clear() alone keeps the capacity
+        std::vector<vertex_t>().swap(this->vertices);
+
+        std::size_t after = this->indices.capacity() * sizeof(GLuint) + this->positions.capacity() * sizeof(Eigen::Vector3f);
+        std::size_t saved = before > after ? before - after : 0;
+        this->m_bytesSaved += saved;
+        return saved;
+    }
+
+    std::vector<unsigned char> mesh_t::pack()
     {
-        // std::cout << "backward" << std::endl;
-        GLfloat velocity = MovementSpeed * deltaTime;
-        if (direction == Camera_Movement::FORWARD)
+        using fmt_t = vertexFormat_t;
+        const auto stride = this->m_format.stride();
+        const auto attribs = this->m_format.attribs();
+        std::vector<unsigned char> out(this->vertices.size() * stride);
+
+        if (this->m_format.position == fmt_t::position_t::QUANT16 && this->vertices.empty() == false)
         {
-            Position += Front * velocity;
+            Eigen::Vector3f lo = this->vertices[0].Position, hi = lo;
+            for (auto &v : this->vertices)
+            {
+                lo = lo.cwiseMin(v.Position);
+                hi = hi.cwiseMax(v.Position);
+            }
+            this->m_dequantOffset = lo;
+            // flat axes keep a non-zero scale so the decode stays finite
+            this->m_dequantScale = (hi - lo).cwiseMax(Eigen::Vector3f::Constant(1e-20f));
         }
-        else if (direction == Camera_Movement::BACKWARD)
+
+        for (std::size_t i = 0; i < this->vertices.size(); i++)
         {
-            Position -= Front * velocity;
+            const auto &v = this->vertices[i];
+            unsigned char *dst = out.data() + i * stride;
+            for (auto &a : attribs)
+            {
+                unsigned char *p = dst + a.offset;
+                switch (a.location)
+                {
+                case 0:
+                    if (this->m_format.position == fmt_t::position_t::QUANT16)
+                    {
+                        Eigen::Vector3f q = (v.Position - this->m_dequantOffset).cwiseQuotient(this->m_dequantScale);
+                        std::uint16_t u[4] = {to_unorm16(q.x()), to_unorm16(q.y()), to_unorm16(q.z()), 0};
+                        std::memcpy(p, u, sizeof(u));
+                    }
+                    else
+                        std::memcpy(p, v.Position.data(), 12);
+                    break;
+                case 1:
+                {
+                    Eigen::Vector3f n = v.Normal.norm() > 0.0f ? v.Normal.normalized() : Eigen::Vector3f::UnitZ();
+                    if (this->m_format.normal == fmt_t::normal_t::OCT16)
+                    {
+                        auto e = oct_encode(n);
+                        std::int16_t s[2] = {to_snorm16(e.x()), to_snorm16(e.y())};
+                        std::memcpy(p, s, sizeof(s));
+                    }
+                    else if (this->m_format.normal == fmt_t::normal_t::INT_2_10_10_10)
+                    {
+                        auto snorm10 = [](float c) -> std::uint32_t
+                        { return static_cast<std::uint32_t>(std::lround(std::clamp(c, -1.0f, 1.0f) * 511.0f)) & 0x3ff; };
+                        std::uint32_t packed = snorm10(n.x()) | (snorm10(n.y()) << 10) | (snorm10(n.z()) << 20);
+                        std::memcpy(p, &packed, sizeof(packed));
+                    }
+                    else
+                        std::memcpy(p, v.Normal.data(), 12);
+                    break;
+                }
+                case 2:
+                    if (this->m_format.texcoord == fmt_t::texcoord_t::HALF2)
+                    {
+                        std::uint16_t h[2] = {float_to_half(v.TexCoords.x()), float_to_half(v.TexCoords.y())};
+                        std::memcpy(p, h, sizeof(h));
+                    }
+                    else if (this->m_format.texcoord == fmt_t::texcoord_t::UNORM16)
+                    {
+                        std::uint16_t u[2] = {to_unorm16(v.TexCoords.x()), to_unorm16(v.TexCoords.y())};
+                        std::memcpy(p, u, sizeof(u));
+                    }
+                    else
+                        std::memcpy(p, v.TexCoords.data(), 8);
+                    break;
+                case 3:
+                    if (this->m_format.tangent == fmt_t::tangent_t::QTANGENT)
+                    {
+                        auto q = qtangent_encode(v.Tangent, v.Bitangent, v.Normal);
+                        std::int16_t s[4] = {to_snorm16(q.x()), to_snorm16(q.y()), to_snorm16(q.z()), to_snorm16(q.w())};
+                        std::memcpy(p, s, sizeof(s));
+                    }
+                    else
+                        std::memcpy(p, v.Tangent.data(), 12);
+                    break;
+                case 4:
+                    std::memcpy(p, v.Bitangent.data(), 12);
+                    break;
+                default:
+                    break;
+                }
+            }
         }
-        else if (direction == Camera_Movement::LEFT)
+        return out;
+    }
+
+    // draws the model, and thus all its meshes
+    void model_t::Draw(shaders::prog_t &shader)
+    {
+        this->m_drawCalls = 0;
+        if (this->m_streams.empty() == false)
+            this->adoptStreams();
+        const bool indirect = this->multiDraw && this->m_arenas.empty() == false && multidraw_supported();
+
+        // one VAO bind per arena, no matter how many submeshes it holds
+        for (auto &a : this->m_arenas)
         {
-            Position -= Right * velocity;
+            glBindVertexArray(a.vao);
+            if (indirect)
+            {
+                if (a.commandsDirty)
+                    this->build_commands(a);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, a.indirect);
+                for (auto &b : a.batches)
+                {
+                    this->meshes[b.mesh].bind_material(shader);
+                    if (b.indexed)
+                        glMultiDrawElementsIndirect(GL_TRIANGLES, a.indexType, (void *)b.offset, b.count, 0);
+                    else
+                        glMultiDrawArraysIndirect(GL_TRIANGLES, (void *)b.offset, b.count, 0);
+                    this->m_drawCalls++;
+                }
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+                continue;
+            }
+            for (auto i : a.meshes)
+            {
+                this->meshes[i].bind_material(shader);
+                this->m_drawCalls += this->meshes[i].submit();
+            }
         }
-        else if (direction == Camera_Movement::RIGHT)
+        if (this->m_arenas.empty() == false)
         {
-            Position += Right * velocity;
+            glBindVertexArray(0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (meshes[i].in_arena() == false)
+            {
+                meshes[i].Draw(shader);
+                this->m_drawCalls += std::max<std::size_t>(1, meshes[i].chunk_count());
+            }
         }
     }
 
-    // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
-    void camera_t::ProcessMouseMovement(GLfloat xoffset, GLfloat yoffset, GLboolean constrainPitch)
+    void model_t::DrawInstanced(shaders::prog_t &shader, const Eigen::Matrix4f *transforms, std::size_t count,
+                                const Eigen::Vector4f *colors)
     {
-        xoffset *= MouseSensitivity;
-        yoffset *= MouseSensitivity;
+        this->m_drawCalls = 0;
+        if (this->m_streams.empty() == false)
+            this->adoptStreams();
+        if (count == 0)
+            return;
 
-        this->Yaw += xoffset;
-        this->Pitch += yoffset;
+        if (this->m_instanceMatrices == 0)
+        {
+            this->m_instanceMatrices = glBuffer_t::create();
+            this->m_instanceColors = glBuffer_t::create();
+        }
+        this->m_instanceCapacity = std::max(this->m_instanceCapacity, count);
 
-        // make sure that when pitch is out of bounds, screen doesn't get flipped
-        if (constrainPitch)
+        // orphan the storage every call, so the driver need not wait for the draws still reading the previous frame
+        glBindBuffer(GL_ARRAY_BUFFER, this->m_instanceMatrices);
+        glBufferData(GL_ARRAY_BUFFER, this->m_instanceCapacity * sizeof(Eigen::Matrix4f), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Eigen::Matrix4f), transforms);
+        if (colors != nullptr)
         {
-            if (Pitch > 89.0f)
-                Pitch = 89.0f;
-            if (Pitch < -89.0f)
-                Pitch = -89.0f;
+            glBindBuffer(GL_ARRAY_BUFFER, this->m_instanceColors);
+            glBufferData(GL_ARRAY_BUFFER, this->m_instanceCapacity * sizeof(Eigen::Vector4f), nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(Eigen::Vector4f), colors);
         }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        // update Front, Right and Up Vectors using the updated Euler angles
-        updateCameraVectors();
+        GLuint bound = 0;
+        auto draw = [&](mesh_t &m)
+        {
+            if (m.m_drawVao != bound)
+            {
+                bound = m.m_drawVao;
+                glBindVertexArray(bound);
+                this->bind_instance_attribs(colors != nullptr);
+            }
+            m.bind_material(shader);
+            this->m_drawCalls += m.submit_instanced(static_cast<GLsizei>(count));
+        };
+        for (auto &a : this->m_arenas)
+        {
+            for (auto i : a.meshes)
+                draw(this->meshes[i]);
+        }
+        for (auto &m : this->meshes)
+        {
+            if (m.in_arena() == false)
+                draw(m);
+        }
+
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
     }
 
-    // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
-    void camera_t::ProcessMouseScroll(GLfloat yoffset)
+    void model_t::bind_instance_attribs(bool colors)
     {
-        Zoom -= (GLfloat)yoffset;
-        if (Zoom < 1.0f)
-            Zoom = 1.0f;
-        if (Zoom > 45.0f)
-            Zoom = 45.0f;
+        // set on every VAO switch: only a few calls, and VAO ids may be recycled after build_arena
+        glBindBuffer(GL_ARRAY_BUFFER, this->m_instanceMatrices);
+        for (GLuint c = 0; c < 4; c++)
+        {
+            glEnableVertexAttribArray(instanceModelLocation + c);
+            glVertexAttribPointer(instanceModelLocation + c, 4, GL_FLOAT, GL_FALSE, sizeof(Eigen::Matrix4f),
+                                  (void *)(c * 4 * sizeof(GLfloat)));
+            glVertexAttribDivisor(instanceModelLocation + c, 1);
+        }
+        if (colors)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, this->m_instanceColors);
+            glEnableVertexAttribArray(instanceColorLocation);
+            glVertexAttribPointer(instanceColorLocation, 4, GL_FLOAT, GL_FALSE, sizeof(Eigen::Vector4f), (void *)0);
+            glVertexAttribDivisor(instanceColorLocation, 1);
+        }
+        else
+        {
+            glDisableVertexAttribArray(instanceColorLocation);
+            glVertexAttrib4f(instanceColorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
-    // calculates the front vector from the Camera's (updated) Euler Angles
-    void camera_t::updateCameraVectors()
+    bool model_t::multidraw_supported()
     {
-        auto radians = [](GLfloat degrees) -> GLfloat
+        static const bool supported = []
         {
-            return degrees * static_cast<GLfloat>(0.01745329251994329576923690768489f);
-        };
+            GLint major = 0, minor = 0;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            return major > 4 || (major == 4 && minor >= 3) || has_extension("GL_ARB_multi_draw_indirect");
+        }();
+        return supported;
+    }
 
-        auto eulerAngle_to_vector = [](GLfloat pitch /*俯仰角*/, GLfloat yaw /*偏航角*/) -> Eigen::Vector3f
+    void model_t::build_commands(arena_t &a)
+    {
+        // layouts of GL's DrawElementsIndirectCommand / DrawArraysIndirectCommand
+        struct elementsCommand_t
         {
-            //右手坐标系
-            auto radians = [](GLfloat v) -> GLfloat
-            {
-                return (v * M_PI) / 180;
-            };
-            pitch = radians(pitch);
-            yaw = radians(yaw);
-            //
-            Eigen::Vector3f front;
-            front.y() = (std::sin(pitch));
-
-            front.x() = (std::cos(yaw) * std::cos(pitch));
-            front.z() = (std::sin(yaw) * std::cos(pitch));
-            front.normalize();
-            return front;
+            GLuint count, instanceCount, firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+        struct arraysCommand_t
+        {
+            GLuint count, instanceCount, first, baseInstance;
         };
 
-        this->Front = eulerAngle_to_vector(this->Pitch, this->Yaw);
+        // batch key: the bound textures; meshes with per-mesh uniforms (dequantization) stay alone
+        auto key_of = [this](std::size_t i)
+        {
+            auto &m = this->meshes[i];
+            std::string key;
+            if (m.m_format.position == vertexFormat_t::position_t::QUANT16)
+                key = "mesh" + std::to_string(i);
+            for (std::size_t t = 0; t < m.textures.size(); t++)
+                key += m.m_samplerNames[t] + "=" + std::to_string(m.textures[t].id) + ";";
+            return key;
+        };
 
-        // u cross v:  cross product 含义是u、v 所构成平面的法向
-        // also re-calculate the Right and Up vector
-        auto c = this->Front.cross(this->WorldUp);
-        c.normalize();
-        this->Right = c; // normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
-        auto cc = this->Right.cross(this->Front);
-        cc.normalize();
-        this->Up = cc;
-    }
+        // order: texture set, then indexed before non-indexed
+        std::vector<std::pair<std::string, std::size_t>> order;
+        for (auto i : a.meshes)
+            order.emplace_back(key_of(i) + (this->meshes[i].m_indexCount == 0 ? "|arrays" : "|elements"), i);
+        std::stable_sort(order.begin(), order.end(),
+                         [](const auto &x, const auto &y)
+                         { return x.first < y.first; });
+
+        std::vector<unsigned char> commands;
+        a.batches.clear();
+        for (std::size_t k = 0; k < order.size(); k++)
+        {
+            auto &m = this->meshes[order[k].second];
+            bool indexed = m.m_indexCount != 0;
+            if (k == 0 || order[k].first != order[k - 1].first)
+                a.batches.push_back({order[k].second, static_cast<GLintptr>(commands.size()), 0, indexed});
 
-};
+            if (indexed)
+            {
+                // one command per chunk, firstIndex counts indices of the arena's index type
+                for (auto &ch : m.m_chunks)
+                {
+                    elementsCommand_t c{static_cast<GLuint>(ch.count), 1,
+                                        static_cast<GLuint>((m.m_firstIndex + ch.firstIndex) / mesh_t::index_size(a.indexType)),
+                                        m.m_baseVertex + ch.baseVertex, 0};
+                    commands.insert(commands.end(), reinterpret_cast<unsigned char *>(&c), reinterpret_cast<unsigned char *>(&c) + sizeof(c));
+                    a.batches.back().count++;
+                }
+            }
+            else
+            {
+                arraysCommand_t c{static_cast<GLuint>(m.m_vertexCount), 1, static_cast<GLuint>(m.m_baseVertex), 0};
+                commands.insert(commands.end(), reinterpret_cast<unsigned char *>(&c), reinterpret_cast<unsigned char *>(&c) + sizeof(c));
+                a.batches.back().count++;
+            }
+        }
 
-namespace shaders
-{
+        a.indirect = glBuffer_t::create();
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, a.indirect);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size(), commands.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        a.commandsDirty = false;
+    }
 
-    // constructor
-    mesh_t::mesh_t(const std::vector<vertex_t> &_vertices, const std::vector<GLuint> &_indices, const std::vector<texture_t> &_textures)
+    std::size_t model_t::build_arena()
     {
-        this->vertices = _vertices;
-        this->indices = _indices;
-        this->textures = _textures;
-
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        return this->pack_arenas(0, {});
     }
 
-    // render the mesh
-    void mesh_t::Draw(shaders::prog_t &shader)
+    void model_t::place_arena(std::vector<arena_t> &arenas, std::size_t firstArena, mesh_t &m)
     {
-        // bind appropriate textures
-        GLuint diffuseNr = 1;
-        GLuint specularNr = 1;
-        GLuint normalNr = 1;
-        GLuint heightNr = 1;
-        for (unsigned int i = 0; i < this->textures.size(); i++)
+        // one index type per arena: a multi-draw takes a single type, and the offsets stay aligned
+        auto same_layout = [](const arena_t &a, const mesh_t &m)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            std::string number;
-            std::string &name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
+            return a.stride == m.m_stride && a.indexType == m.m_indexType && a.attribs.size() == m.m_attribs.size() &&
+                   std::equal(a.attribs.begin(), a.attribs.end(), m.m_attribs.begin(),
+                              [](const vertexFormat_t::attrib_t &x, const vertexFormat_t::attrib_t &y)
+                              {
+                                  return x.location == y.location && x.size == y.size && x.type == y.type &&
+                                         x.normalized == y.normalized && x.offset == y.offset;
+                              });
+        };
+        auto iter = std::find_if(arenas.begin() + firstArena, arenas.end(),
+                                 [&](const arena_t &a)
+                                 { return same_layout(a, m); });
+        if (iter == arenas.end())
+        {
+            arenas.emplace_back();
+            iter = arenas.end() - 1;
+            iter->stride = m.m_stride;
+            iter->indexType = m.m_indexType;
+            iter->attribs = m.m_attribs;
+        }
+        m.m_arena = static_cast<int>(iter - arenas.begin());
+        m.m_baseVertex = static_cast<GLint>(iter->vertexBytes / iter->stride);
+        m.m_firstIndex = iter->indexBytes;
+        iter->vertexBytes += m.vertex_bytes();
+        iter->indexBytes += m.index_bytes();
+    }
 
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.progid, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    void model_t::create_arena(arena_t &a)
+    {
+        a.vbo = glBuffer_t::create();
+        a.ebo = glBuffer_t::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, a.vbo);
+        glBufferData(GL_COPY_WRITE_BUFFER, a.vertexBytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, a.ebo);
+        glBufferData(GL_COPY_WRITE_BUFFER, a.indexBytes, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        a.vao = glVertexArray_t::create();
+        glBindVertexArray(a.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, a.vbo);
+        for (auto &attr : a.attribs)
+        {
+            glEnableVertexAttribArray(attr.location);
+            glVertexAttribPointer(attr.location, attr.size, attr.type, attr.normalized, a.stride, (void *)(std::uintptr_t)attr.offset);
         }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, a.ebo);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-        // draw mesh
-        glBindVertexArray(this->VAO);
-        if (this->indices.size() == 0)
+    void model_t::fill_arena(const arena_t &a, mesh_t &m, const meshData_t &data)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, a.vbo);
+        if (data.vertices != nullptr)
+            glBufferSubData(GL_COPY_WRITE_BUFFER, m.m_baseVertex * static_cast<GLintptr>(a.stride), m.vertex_bytes(), data.vertices);
+        else
         {
-            glDrawArrays(GL_TRIANGLES, 0, this->vertices.size());
+            glBindBuffer(GL_COPY_READ_BUFFER, m.VBO);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, m.m_baseVertex * static_cast<GLintptr>(a.stride), m.vertex_bytes());
         }
-        else
+        if (m.index_bytes() > 0)
         {
-            glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, a.ebo);
+            if (data.vertices != nullptr)
+                glBufferSubData(GL_COPY_WRITE_BUFFER, m.m_firstIndex, m.index_bytes(), data.indices);
+            else
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, m.EBO);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, m.m_firstIndex, m.index_bytes());
+            }
         }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+        m.m_drawVao = a.vao;
+        m.VAO.reset();
+        m.VBO.reset();
+        m.EBO.reset();
     }
 
-    // initializes all the buffer objects/arrays
-    void mesh_t::setupMesh()
+    std::size_t model_t::pack_arenas(std::size_t first, const std::vector<meshData_t> &data)
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &(this->VAO));
-        glGenBuffers(1, &(this->VBO));
-        glGenBuffers(1, &(this->EBO));
+        // group the meshes not packed yet by layout
+        const std::size_t firstArena = this->m_arenas.size();
+        std::vector<std::size_t> placed;
+        for (std::size_t i = first; i < this->meshes.size(); i++)
+        {
+            auto &m = this->meshes[i];
+            if (m.in_arena())
+                continue;
+            if (m.m_vertexCount == 0)
+            {
+                // nothing to share, but a mesh without any buffer still needs its VAO
+                if (data.empty() == false)
+                    m.upload(nullptr, 0, data[i - first].indices, m.index_bytes());
+                continue;
+            }
+            // no buffers of its own: the mesh of a load still streaming, it joins the arena of that load
+            if (data.empty() && m.VBO == 0)
+                continue;
+            place_arena(this->m_arenas, firstArena, m);
+            placed.push_back(i);
+        }
 
-        glBindVertexArray(this->VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex_t), &vertices[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+        for (std::size_t k = firstArena; k < this->m_arenas.size(); k++)
+            create_arena(this->m_arenas[k]);
+        // staged data goes straight into the arena; meshes already on the GPU are copied there, their CPU copies may be gone
+        for (auto i : placed)
+        {
+            auto &m = this->meshes[i];
+            auto &a = this->m_arenas[m.m_arena];
+            fill_arena(a, m, data.empty() ? meshData_t{nullptr, nullptr} : data[i - first]);
+            a.meshes.push_back(i);
+        }
+        return this->m_arenas.size() - firstArena;
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (void *)offsetof(vertex_t, Bitangent));
+    std::size_t model_t::bytes_saved() const
+    {
+        std::size_t total = 0;
+        for (auto &m : this->meshes)
+            total += m.bytes_saved();
+        return total;
+    }
 
-        glBindVertexArray(0);
+    meshopt::weldReport_t model_t::weld_report() const
+    {
+        meshopt::weldReport_t total;
+        for (auto &m : this->meshes)
+        {
+            total.input += m.weld_report().input;
+            total.output += m.weld_report().output;
+        }
+        return total;
     }
 
-    // draws the model, and thus all its meshes
-    void model_t::Draw(shaders::prog_t &shader)
+    meshopt::report_t model_t::cache_report() const
     {
-        for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        meshopt::report_t total;
+        for (auto &m : this->meshes)
+        {
+            auto &r = m.cache_report();
+            if (r.triangles == 0)
+                continue;
+            float w = static_cast<float>(r.triangles);
+            total.before.acmr += r.before.acmr * w;
+            total.before.atvr += r.before.atvr * w;
+            total.after.acmr += r.after.acmr * w;
+            total.after.atvr += r.after.atvr * w;
+            total.triangles += r.triangles;
+            total.vertices_dropped += r.vertices_dropped;
+            total.overdraw = total.overdraw || r.overdraw;
+        }
+        if (total.triangles > 0)
+        {
+            float w = static_cast<float>(total.triangles);
+            total.before.acmr /= w;
+            total.before.atvr /= w;
+            total.after.acmr /= w;
+            total.after.atvr /= w;
+        }
+        return total;
     }
 
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void model_t::loadModel(const std::filesystem::path &path)
     {
+        // retrieve the directory path of the filepath
+        auto absolute = std::filesystem::absolute(path);
+        this->m_loadedCooked = false;
+        if (this->cooked)
+        {
+            auto saved = this->directory;
+            this->directory = absolute.parent_path().string();
+            if (this->loadCooked(absolute))
+            {
+                this->m_loadedCooked = true;
+                return;
+            }
+            this->directory = saved;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(path.string(), aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+        // without JoinIdenticalVertices every face has its own vertices and there is no reuse to optimize for
+        const aiScene *scene = importer.ReadFile(path.string(), importFlags);
         // check for errors
         if (nullptr == scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        auto absolute = std::filesystem::absolute(path);
         this->directory = absolute.parent_path().string();
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        const auto first = this->meshes.size();
+        auto bones = processNode(scene->mRootNode, scene);
+        if (this->cooked && this->meshes.size() > first && this->writeCooked(absolute, first, bones) == false)
+            std::cout << path.string() << ": cannot write the cooked model to " << this->cooked_file(this->cooked_key(absolute)) << std::endl;
+    }
+
+    std::uint64_t model_t::cooked_key(const std::filesystem::path &path) const
+    {
+        std::error_code ec;
+        std::uint64_t size = std::filesystem::file_size(path, ec);
+        auto mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        // '\0' separator so that the path cannot run into the numbers
+        auto h = fnv1a(path.string());
+        h = fnv1a("", 1, h);
+        h = fnv1a(&size, sizeof(size), h);
+        h = fnv1a(&mtime, sizeof(mtime), h);
+        std::uint32_t settings[5] = {static_cast<std::uint32_t>(this->vertexFormat.position), static_cast<std::uint32_t>(this->vertexFormat.normal),
+                                     static_cast<std::uint32_t>(this->vertexFormat.texcoord), static_cast<std::uint32_t>(this->vertexFormat.tangent),
+                                     this->meshOptimization ? 1u : 0u};
+        return fnv1a(settings, sizeof(settings), h);
+    }
+
+    std::filesystem::path model_t::cooked_file(std::uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.glmodel", static_cast<unsigned long long>(key));
+        return cache_root() / "models" / name;
+    }
+
+    bool model_t::writeCooked(const std::filesystem::path &path, std::size_t first, const std::vector<std::string> &bones)
+    {
+        std::vector<unsigned char> out;
+        auto put = [&out](const void *data, std::size_t len)
+        {
+            auto p = static_cast<const unsigned char *>(data);
+            out.insert(out.end(), p, p + len);
+        };
+        auto put_string = [&](const std::string &str)
+        {
+            std::uint32_t len = static_cast<std::uint32_t>(str.size());
+            put(&len, sizeof(len));
+            put(str.data(), len);
+        };
+        // buffers start 16-byte aligned, so that they can be used in place from the mapping
+        auto align = [&out]()
+        {
+            out.resize((out.size() + 15) & ~std::size_t(15), 0);
+        };
+
+        cookedHeader_t hdr{};
+        std::memcpy(hdr.magic, "MGLMODL", 8);
+        hdr.version = COOKED_VERSION;
+        hdr.meshes = static_cast<std::uint32_t>(this->meshes.size() - first);
+        hdr.key = this->cooked_key(path);
+        // bones of other imports into this model stay out, a cooked reload gets what a fresh import would
+        hdr.bones = static_cast<std::uint32_t>(bones.size());
+        hdr.boneCount = 0;
+        for (auto &name : bones)
+            hdr.boneCount = std::max(hdr.boneCount, this->m_OffsetMatMap.at(name).id + 1);
+        put(&hdr, sizeof(hdr));
+
+        std::vector<unsigned char> buffer;
+        for (std::size_t i = first; i < this->meshes.size(); i++)
+        {
+            auto &m = this->meshes[i];
+            auto &r = m.m_cacheReport;
+            cookedMesh_t cm{};
+            cm.vertexCount = static_cast<std::uint32_t>(m.m_vertexCount);
+            cm.indexCount = static_cast<std::uint32_t>(m.m_indexCount);
+            cm.stride = static_cast<std::uint32_t>(m.m_stride);
+            cm.indexType = m.m_indexType;
+            cm.attribs = static_cast<std::uint32_t>(m.m_attribs.size());
+            cm.chunks = static_cast<std::uint32_t>(m.m_chunks.size());
+            cm.textures = static_cast<std::uint32_t>(m.textures.size());
+            cm.overdraw = r.overdraw ? 1 : 0;
+            cm.format[0] = static_cast<std::uint32_t>(m.m_format.position);
+            cm.format[1] = static_cast<std::uint32_t>(m.m_format.normal);
+            cm.format[2] = static_cast<std::uint32_t>(m.m_format.texcoord);
+            cm.format[3] = static_cast<std::uint32_t>(m.m_format.tangent);
+            for (int k = 0; k < 3; k++)
+            {
+                cm.dequantScale[k] = m.m_dequantScale[k];
+                cm.dequantOffset[k] = m.m_dequantOffset[k];
+            }
+            float stats[4] = {r.before.acmr, r.before.atvr, r.after.acmr, r.after.atvr};
+            std::memcpy(cm.cacheStats, stats, sizeof(stats));
+            cm.triangles = r.triangles;
+            cm.verticesDropped = r.vertices_dropped;
+            cm.vertexBytes = static_cast<std::uint64_t>(m.vertex_bytes());
+            cm.indexBytes = static_cast<std::uint64_t>(m.index_bytes());
+            put(&cm, sizeof(cm));
+
+            for (auto &a : m.m_attribs)
+            {
+                std::uint32_t fields[5] = {a.location, static_cast<std::uint32_t>(a.size), a.type, a.normalized,
+                                           static_cast<std::uint32_t>(a.offset)};
+                put(fields, sizeof(fields));
+            }
+            for (auto &c : m.m_chunks)
+            {
+                std::int64_t fields[3] = {c.count, c.firstIndex, c.baseVertex};
+                put(fields, sizeof(fields));
+            }
+            for (auto &t : m.textures)
+            {
+                put_string(t.type);
+                put_string(t.path);
+            }
+
+            // the buffers exactly as uploaded, the CPU copies may already be released; arena meshes are a range of the arena's
+            align();
+            buffer.resize(cm.vertexBytes);
+            glBindBuffer(GL_COPY_READ_BUFFER, m.in_arena() ? this->m_arenas[m.m_arena].vbo : m.VBO);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, m.in_arena() ? m.m_baseVertex * static_cast<GLintptr>(m.m_stride) : 0,
+                               buffer.size(), buffer.data());
+            put(buffer.data(), buffer.size());
+            align();
+            if (cm.indexBytes > 0)
+            {
+                buffer.resize(cm.indexBytes);
+                glBindBuffer(GL_COPY_READ_BUFFER, m.in_arena() ? this->m_arenas[m.m_arena].ebo : m.EBO);
+                glGetBufferSubData(GL_COPY_READ_BUFFER, m.in_arena() ? m.m_firstIndex : 0, buffer.size(), buffer.data());
+                put(buffer.data(), buffer.size());
+            }
+            align();
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        for (auto &name : bones)
+        {
+            auto &bone = this->m_OffsetMatMap.at(name);
+            put_string(name);
+            put(&bone.id, sizeof(bone.id));
+            put(bone.offset.data(), sizeof(GLfloat) * 16);
+        }
+
+        std::error_code ec;
+        auto file = this->cooked_file(hdr.key);
+        std::filesystem::create_directories(file.parent_path(), ec);
+        // write to a temporary name first, concurrent processes must never map a half written file
+        auto tmp = file;
+        tmp += ".tmp";
+        {
+            std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+            if (f.fail())
+                return false;
+            f.write(reinterpret_cast<const char *>(out.data()), out.size());
+            if (f.fail())
+                return false;
+        }
+        std::filesystem::rename(tmp, file, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+    bool model_t::loadCooked(const std::filesystem::path &path)
+    {
+        const auto key = this->cooked_key(path);
+        mappedFile_t file(this->cooked_file(key));
+        if (file.valid() == false)
+            return false;
+
+        // every read is bounds checked, a truncated or corrupt file is rejected as a whole
+        std::size_t at = 0;
+        auto take = [&](std::size_t len) -> const unsigned char *
+        {
+            if (len > file.size() - at)
+                return nullptr;
+            auto p = file.data() + at;
+            at += len;
+            return p;
+        };
+        auto get = [&](void *dst, std::size_t len)
+        {
+            auto p = take(len);
+            if (p != nullptr)
+                std::memcpy(dst, p, len);
+            return p != nullptr;
+        };
+        auto get_string = [&](std::string &str)
+        {
+            std::uint32_t len = 0;
+            if (get(&len, sizeof(len)) == false)
+                return false;
+            auto p = take(len);
+            if (p != nullptr)
+                str.assign(reinterpret_cast<const char *>(p), len);
+            return p != nullptr;
+        };
+        auto align = [&]()
+        {
+            at = std::min(file.size(), (at + 15) & ~std::size_t(15));
+        };
+
+        cookedHeader_t hdr;
+        if (get(&hdr, sizeof(hdr)) == false || std::memcmp(hdr.magic, "MGLMODL", 8) != 0 ||
+            hdr.version != COOKED_VERSION || hdr.key != key)
+            return false;
+
+        // parse everything first, nothing is created unless the whole file is valid
+        struct pending_t
+        {
+            cookedMesh_t cm;
+            std::vector<vertexFormat_t::attrib_t> attribs;
+            std::vector<mesh_t::chunk_t> chunks;
+            std::vector<std::pair<std::string, std::string>> textures; // type, path
+            const unsigned char *vertexData, *indexData;
+        };
+        // bytes of one attribute in the vertex, 0 for anything writeCooked never produces
+        auto attrib_bytes = [](std::uint32_t size, std::uint32_t type) -> std::uint64_t
+        {
+            if (size < 1 || size > 4)
+                return 0;
+            switch (type)
+            {
+            case GL_FLOAT:
+                return 4 * size;
+            case GL_HALF_FLOAT:
+            case GL_SHORT:
+            case GL_UNSIGNED_SHORT:
+                return 2 * size;
+            case GL_INT_2_10_10_10_REV:
+                return 4;
+            default:
+                return 0;
+            }
+        };
+
+        // counts come from the file, never allocate more records than the remaining bytes can hold
+        if (hdr.meshes > (file.size() - at) / sizeof(cookedMesh_t))
+            return false;
+        std::vector<pending_t> pending(hdr.meshes);
+        for (auto &pm : pending)
+        {
+            auto &cm = pm.cm;
+            if (get(&cm, sizeof(cm)) == false)
+                return false;
+            if ((cm.indexType != GL_UNSIGNED_SHORT && cm.indexType != GL_UNSIGNED_INT) ||
+                (cm.vertexCount > 0 && cm.stride == 0) || cm.stride > 2048)
+                return false;
+            for (std::uint32_t k = 0; k < cm.attribs; k++)
+            {
+                std::uint32_t f[5];
+                if (get(f, sizeof(f)) == false)
+                    return false;
+                // location, size, type, normalized, offset
+                const auto bytes = attrib_bytes(f[1], f[2]);
+                if (f[0] >= 16 || bytes == 0 || f[4] + bytes > cm.stride)
+                    return false;
+                pm.attribs.push_back({f[0], static_cast<GLint>(f[1]), f[2], static_cast<GLboolean>(f[3]), static_cast<GLsizei>(f[4])});
+            }
+            const auto isz = static_cast<std::int64_t>(mesh_t::index_size(cm.indexType));
+            std::uint64_t chunkIndices = 0;
+            for (std::uint32_t k = 0; k < cm.chunks; k++)
+            {
+                std::int64_t f[3];
+                if (get(f, sizeof(f)) == false)
+                    return false;
+                // count, firstIndex (bytes), baseVertex; every chunk has to stay inside its own mesh
+                if (f[0] < 0 || f[0] > cm.indexCount || f[1] < 0 || f[1] % isz != 0 ||
+                    static_cast<std::uint64_t>(f[1] + f[0] * isz) > cm.indexBytes ||
+                    f[2] < 0 || (f[0] > 0 && f[2] >= cm.vertexCount))
+                    return false;
+                chunkIndices += static_cast<std::uint64_t>(f[0]);
+                pm.chunks.push_back({static_cast<GLsizei>(f[0]), static_cast<GLsizeiptr>(f[1]), static_cast<GLint>(f[2])});
+            }
+            if (chunkIndices != cm.indexCount)
+                return false;
+            for (std::uint32_t k = 0; k < cm.textures; k++)
+            {
+                std::string type, file;
+                if (get_string(type) == false || get_string(file) == false)
+                    return false;
+                pm.textures.emplace_back(std::move(type), std::move(file));
+            }
+            align();
+            pm.vertexData = take(cm.vertexBytes);
+            align();
+            pm.indexData = take(cm.indexBytes);
+            align();
+            if (pm.vertexData == nullptr || pm.indexData == nullptr ||
+                cm.vertexBytes != static_cast<std::uint64_t>(cm.vertexCount) * cm.stride ||
+                cm.indexBytes != cm.indexCount * static_cast<std::uint64_t>(mesh_t::index_size(cm.indexType)))
+                return false;
+            // the GPU would read out of the vertex buffer on a bad index, check them like the records above
+            for (auto &c : pm.chunks)
+            {
+                for (GLsizei k = 0; k < c.count; k++)
+                {
+                    auto p = pm.indexData + c.firstIndex + k * isz;
+                    std::uint64_t index = 0;
+                    if (cm.indexType == GL_UNSIGNED_SHORT)
+                    {
+                        GLushort narrow;
+                        std::memcpy(&narrow, p, sizeof(narrow));
+                        index = narrow;
+                    }
+                    else
+                    {
+                        GLuint wide;
+                        std::memcpy(&wide, p, sizeof(wide));
+                        index = wide;
+                    }
+                    if (index + c.baseVertex >= cm.vertexCount)
+                        return false;
+                }
+            }
+        }
+        // a bone takes at least its name length, id and offset matrix
+        if (hdr.bones > (file.size() - at) / (sizeof(std::uint32_t) + sizeof(int) + sizeof(GLfloat) * 16))
+            return false;
+        std::vector<std::pair<std::string, boneInfo_t>> bones(hdr.bones);
+        for (auto &b : bones)
+        {
+            if (get_string(b.first) == false || get(&b.second.id, sizeof(b.second.id)) == false ||
+                get(b.second.offset.data(), sizeof(GLfloat) * 16) == false ||
+                b.second.id < 0 || b.second.id >= hdr.boneCount)
+                return false;
+        }
+
+        textureRefs_t refs;
+        for (auto &pm : pending)
+            for (auto &t : pm.textures)
+                refs.emplace_back(t.second, t.first);
+        auto textures = this->prefetchTextures(refs);
+
+        const auto first = this->meshes.size();
+        this->meshes.reserve(first + pending.size());
+        std::vector<meshData_t> data;
+        for (auto &pm : pending)
+        {
+            auto &cm = pm.cm;
+            mesh_t m;
+            m.m_format.position = static_cast<vertexFormat_t::position_t>(cm.format[0]);
+            m.m_format.normal = static_cast<vertexFormat_t::normal_t>(cm.format[1]);
+            m.m_format.texcoord = static_cast<vertexFormat_t::texcoord_t>(cm.format[2]);
+            m.m_format.tangent = static_cast<vertexFormat_t::tangent_t>(cm.format[3]);
+            m.m_attribs = std::move(pm.attribs);
+            m.m_stride = static_cast<GLsizei>(cm.stride);
+            m.m_vertexCount = cm.vertexCount;
+            m.m_indexCount = cm.indexCount;
+            m.m_indexType = cm.indexType;
+            m.m_chunks = std::move(pm.chunks);
+            m.m_dequantScale = Eigen::Vector3f(cm.dequantScale[0], cm.dequantScale[1], cm.dequantScale[2]);
+            m.m_dequantOffset = Eigen::Vector3f(cm.dequantOffset[0], cm.dequantOffset[1], cm.dequantOffset[2]);
+            m.m_cacheReport.before = {cm.cacheStats[0], cm.cacheStats[1]};
+            m.m_cacheReport.after = {cm.cacheStats[2], cm.cacheStats[3]};
+            m.m_cacheReport.triangles = cm.triangles;
+            m.m_cacheReport.vertices_dropped = cm.verticesDropped;
+            m.m_cacheReport.overdraw = cm.overdraw != 0;
+            for (auto &t : pm.textures)
+                m.textures.push_back(this->materialTexture(t.second, t.first));
+            m.nameSamplers();
+
+            // no per-vertex work: the mapped bytes go to the driver as they are
+            if (this->packArenas)
+                data.push_back({pm.vertexData, pm.indexData});
+            else
+                m.upload(pm.vertexData, static_cast<GLsizeiptr>(cm.vertexBytes), pm.indexData, static_cast<GLsizeiptr>(cm.indexBytes));
+
+            if (this->residency != residency_t::DROP)
+            {
+                for (auto &c : m.m_chunks)
+                {
+                    for (GLsizei k = 0; k < c.count; k++)
+                    {
+                        auto p = pm.indexData + c.firstIndex + k * mesh_t::index_size(m.m_indexType);
+                        GLuint index = 0;
+                        if (m.m_indexType == GL_UNSIGNED_SHORT)
+                        {
+                            GLushort narrow;
+                            std::memcpy(&narrow, p, sizeof(narrow));
+                            index = narrow;
+                        }
+                        else
+                        {
+                            std::memcpy(&index, p, sizeof(index));
+                        }
+                        m.indices.push_back(index + c.baseVertex);
+                    }
+                }
+                auto pos = std::find_if(m.m_attribs.begin(), m.m_attribs.end(), [](const vertexFormat_t::attrib_t &a)
+                                        { return a.location == 0 && a.type == GL_FLOAT && a.size == 3; });
+                if (pos != m.m_attribs.end())
+                {
+                    m.positions.resize(m.m_vertexCount);
+                    for (std::size_t v = 0; v < m.m_vertexCount; v++)
+                        std::memcpy(m.positions[v].data(), pm.vertexData + v * cm.stride + pos->offset, sizeof(Eigen::Vector3f));
+                }
+            }
+            this->meshes.push_back(std::move(m));
+        }
+        if (this->packArenas)
+            this->pack_arenas(first, data);
+        // the ids in the file were given by another model, take them from this one's table
+        for (auto &b : bones)
+        {
+            auto iter = this->m_OffsetMatMap.find(b.first);
+            b.second.id = iter != this->m_OffsetMatMap.end() ? iter->second.id : this->bone_id(b.first);
+            this->m_OffsetMatMap[b.first] = b.second;
+            this->m_BoneCount = std::max(this->m_BoneCount, b.second.id + 1);
+        }
+        return true;
     }
 
     bool model_t::loadNativeData(int cols,
                                  vertexAttrib_t howto_do,
                                  const std::vector<GLfloat> &vertexNative,
-                                 std::initializer_list<std::tuple<aiTextureType /*纹理类型*/,
-                                                                  std::string /*纹理图片路径*/>>
-                                     _texturesNative,
+                                 nativeTextures_t _texturesNative,
                                  const std::vector<GLuint> &_indices)
     {
         //check
@@ -974,6 +5923,7 @@ namespace shaders
         const auto rows = vertexNative.size() / cols;
 
         std::vector<mesh_t::vertex_t> vertices;
+        vertices.reserve(rows);
         {
             for (int i = 0; i < rows; i++)
             {
@@ -983,93 +5933,548 @@ namespace shaders
 
                 for (auto &&t : howto_do)
                 {
-                    auto oft = start_i + std::get<1>(t);
-                    auto m = Eigen::Vector3f(vertexNative[oft], vertexNative[oft + 1], vertexNative[oft + 2]);
-                    switch (std::get<0>(t))
+                    auto oft = start_i + std::get<1>(t);
+                    auto m = Eigen::Vector3f(vertexNative[oft], vertexNative[oft + 1], vertexNative[oft + 2]);
+                    switch (std::get<0>(t))
+                    {
+                    case vertexType_t::POSITION_ENU:
+                        v.Position = m;
+                        break;
+                    case vertexType_t::NORMAL_ENU:
+                        v.Normal = m;
+                        break;
+                    case vertexType_t::TEXCOORD_ENU:
+                        v.TexCoords = m.head(2);
+                        break;
+                    case vertexType_t::TANGENT_ENU:
+                        v.Tangent = m;
+                        break;
+                    case vertexType_t::BITTANGENT_ENU:
+                        v.Bitangent = m;
+                        break;
+                    default:
+                        break;
+                    }
+                }
+                vertices.push_back(v);
+            }
+        }
+
+        auto textures = this->loadNativeTextures(_texturesNative);
+
+        auto indices = _indices;
+        meshopt::weldReport_t weld;
+        if (this->weldVertices && vertices.empty() == false)
+        {
+            // only the attributes named in howto_do carry data
+            std::vector<vertexFormat_t::attrib_t> selected;
+            auto base = reinterpret_cast<const unsigned char *>(&vertices[0]);
+            auto field = [&](const auto &member, GLint size)
+            {
+                auto offset = reinterpret_cast<const unsigned char *>(&member) - base;
+                selected.push_back({0, size, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(offset)});
+            };
+            for (auto &&t : howto_do)
+            {
+                switch (std::get<0>(t))
+                {
+                case vertexType_t::POSITION_ENU:
+                    field(vertices[0].Position, 3);
+                    break;
+                case vertexType_t::NORMAL_ENU:
+                    field(vertices[0].Normal, 3);
+                    break;
+                case vertexType_t::TEXCOORD_ENU:
+                    field(vertices[0].TexCoords, 2);
+                    break;
+                case vertexType_t::TANGENT_ENU:
+                    field(vertices[0].Tangent, 3);
+                    break;
+                case vertexType_t::BITTANGENT_ENU:
+                    field(vertices[0].Bitangent, 3);
+                    break;
+                default:
+                    break;
+                }
+            }
+            std::vector<unsigned char> rows;
+            weld = this->weld_mesh(vertices.data(), vertices.size(), sizeof(mesh_t::vertex_t),
+                                   selected.data(), selected.size(), rows, indices);
+            if (weld.input > 0)
+            {
+                vertices.resize(weld.output);
+                std::memcpy(static_cast<void *>(vertices.data()), rows.data(), rows.size());
+            }
+        }
+        auto report = this->optimize_mesh(vertices, indices);
+        auto &mesh = this->meshes.emplace_back(std::move(vertices), std::move(indices), std::move(textures), this->vertexFormat);
+        mesh.m_cacheReport = report;
+        mesh.m_weldReport = weld;
+        mesh.apply_residency(this->residency);
+        return true;
+    };
+
+    std::vector<mesh_t::texture_t> model_t::loadNativeTextures(nativeTextures_t _texturesNative)
+    {
+        std::vector<mesh_t::texture_t> textures;
+        auto aiTextureType_to_str = [](aiTextureType type_) -> std::string
+        {
+            switch (type_)
+            {
+            case aiTextureType_DIFFUSE:
+                return "texture_diffuse";
+                break;
+            case aiTextureType_SPECULAR:
+                return "texture_specular";
+                break;
+            case aiTextureType_HEIGHT:
+                return "texture_normal";
+                break;
+            case aiTextureType_AMBIENT:
+                return "texture_height";
+                break;
+            default:
+                return "";
+            }
+        };
+        // files already loaded by any model come from textureRegistry_t
+        for (auto &&text : _texturesNative)
+        {
+            mesh_t::texture_t t;
+            t.type = aiTextureType_to_str(std::get<0>(text));
+            auto pth = std::filesystem::path(std::get<1>(text));
+            t.path = pth.string();
+            if (std::filesystem::is_directory(pth))
+            {
+                std::cout << t.path << ": is a directory. not a valid filepath" << std::endl;
+                continue;
+            }
+            t.id = this->TextureFromFile(pth.filename().string(), pth.parent_path().string(), this->srgb(t.type));
+            textures.push_back(t);
+        }
+        return textures;
+    };
+
+    bool model_t::loadLayoutData(const void *interleaved, std::size_t count, GLsizei stride,
+                                 const vertexFormat_t::attrib_t *attribs, std::size_t nattribs,
+                                 nativeTextures_t _texturesNative, const std::vector<GLuint> &_indices)
+    {
+        auto textures = this->loadNativeTextures(_texturesNative);
+        auto pos = std::find_if(attribs, attribs + nattribs, [](const vertexFormat_t::attrib_t &a)
+                                { return a.location == 0 && a.type == GL_FLOAT && a.size == 3; });
+
+        // the caller's rows are const, weld and optimize a copy
+        auto indices = _indices;
+        std::vector<unsigned char> rows;
+        meshopt::weldReport_t weld;
+        if (this->weldVertices)
+        {
+            weld = this->weld_mesh(interleaved, count, stride, attribs, nattribs, rows, indices);
+            if (weld.input > 0)
+            {
+                count = weld.output;
+                interleaved = rows.data();
+            }
+        }
+        meshopt::report_t report;
+        if (this->meshOptimization && indices.empty() == false)
+        {
+            auto bytes = static_cast<const unsigned char *>(interleaved);
+            if (rows.empty())
+                rows.assign(bytes, bytes + count * stride);
+            report = meshopt::optimize(rows.data(), count, stride, pos != attribs + nattribs ? pos->offset : -1, indices);
+            interleaved = rows.data();
+        }
+
+        auto &mesh = this->meshes.emplace_back(interleaved, count, stride, attribs, nattribs, std::move(indices), std::move(textures));
+        mesh.m_cacheReport = report;
+        mesh.m_weldReport = weld;
+        // the interleaved rows are not kept by mesh_t, copy the float positions out while they are at hand
+        if (this->residency == residency_t::POSITIONS && pos != attribs + nattribs)
+        {
+            auto bytes = static_cast<const unsigned char *>(interleaved);
+            mesh.positions.resize(count);
+            for (std::size_t i = 0; i < count; i++)
+                std::memcpy(mesh.positions[i].data(), bytes + i * stride + pos->offset, sizeof(Eigen::Vector3f));
+        }
+        mesh.apply_residency(this->residency);
+        return true;
+    };
+
+    std::vector<std::string> model_t::processNode(aiNode *node, const aiScene *scene)
+    {
+        converted_t c;
+        this->convertNode(node, scene, c);
+        // every texture of the import in one batch decoded on all cores, the meshes below find them in the registry
+        textureRefs_t all;
+        for (auto &refs : c.textures)
+            all.insert(all.end(), refs.begin(), refs.end());
+        auto textures = this->prefetchTextures(all);
+        const auto first = this->meshes.size();
+        this->meshes.reserve(first + c.meshes.size());
+        for (std::size_t i = 0; i < c.meshes.size(); i++)
+            this->uploadConverted(c, i, this->packArenas == false);
+        if (this->packArenas)
+        {
+            std::vector<meshData_t> data;
+            for (auto &st : c.staged)
+                data.push_back({st.vertices.data(), st.indices.data()});
+            this->pack_arenas(first, data);
+        }
+        return std::move(c.bones);
+    }
+
+    void model_t::convertNode(aiNode *node, const aiScene *scene, converted_t &out)
+    {
+        // flatten the graph in the order of a recursive walk: the meshes of a node, then its children
+        std::vector<aiMesh *> order;
+        std::vector<aiNode *> stack{node};
+        while (stack.empty() == false)
+        {
+            aiNode *n = stack.back();
+            stack.pop_back();
+            // the node object only contains indices to index the actual objects in the scene.
+            for (unsigned int i = 0; i < n->mNumMeshes; i++)
+                order.push_back(scene->mMeshes[n->mMeshes[i]]);
+            for (unsigned int i = n->mNumChildren; i > 0; i--)
+                stack.push_back(n->mChildren[i - 1]);
+        }
+
+        // bone ids depend on the order the bones are met in, hand them out before going parallel
+        std::unordered_set<std::string> seen;
+        for (auto m : order)
+        {
+            this->registerBones(m);
+            for (unsigned int b = 0; b < m->mNumBones; b++)
+                if (seen.insert(m->mBones[b]->mName.C_Str()).second)
+                    out.bones.push_back(m->mBones[b]->mName.C_Str());
+        }
+
+        // convert, optimize, pack and encode every mesh on the worker pool
+        out.meshes.reserve(order.size());
+        for (std::size_t i = 0; i < order.size(); i++)
+            out.meshes.push_back(mesh_t());
+        out.staged.resize(order.size());
+        out.textures.resize(order.size());
+        threadPool_t::instance().parallel_for(order.size(), [&](std::size_t begin, std::size_t end)
+                                              {
+                                                  for (std::size_t i = begin; i < end; i++)
+                                                  {
+                                                      this->processMesh(order[i], scene, out.meshes[i], out.staged[i]);
+                                                      out.textures[i] = this->materialTextureRefs(scene->mMaterials[order[i]->mMaterialIndex]);
+                                                  } },
+                                              1);
+    }
+
+    void model_t::uploadConverted(converted_t &c, std::size_t i, bool upload)
+    {
+        auto &m = c.meshes[i];
+        for (auto &[file, type] : c.textures[i])
+            m.textures.push_back(this->materialTexture(file, type));
+        m.nameSamplers();
+        if (upload)
+        {
+            m.upload(c.staged[i].vertices.data(), static_cast<GLsizeiptr>(c.staged[i].vertices.size()),
+                     c.staged[i].indices.data(), static_cast<GLsizeiptr>(c.staged[i].indices.size()));
+            // the staged copies are not needed any more, free them as we go
+            mesh_t::staged_t().vertices.swap(c.staged[i].vertices);
+            mesh_t::staged_t().indices.swap(c.staged[i].indices);
+        }
+        this->meshes.push_back(std::move(m));
+        this->meshes.back().apply_residency(this->residency);
+    }
+
+    std::shared_ptr<modelStream_t> model_t::loadModelAsync(const std::filesystem::path &path)
+    {
+        auto stream = std::make_shared<modelStream_t>();
+        auto &scratch = stream->m_scratch;
+        scratch.gammaCorrection = this->gammaCorrection;
+        scratch.vertexFormat = this->vertexFormat;
+        scratch.residency = this->residency;
+        scratch.meshOptimization = this->meshOptimization;
+        scratch.packArenas = this->packArenas;
+        scratch.uploadSliceBytes = std::max<GLsizeiptr>(this->uploadSliceBytes, 1);
+        scratch.directory = std::filesystem::absolute(path).parent_path().string();
+        // new bones take their ids from the table of this model, textures are shared through textureRegistry_t anyway
+        scratch.m_OffsetMatMap = this->m_OffsetMatMap;
+        scratch.m_BoneCount = this->m_BoneCount;
+        if (this->m_boneIds == nullptr)
+            this->m_boneIds = std::make_shared<boneIds_t>();
+        scratch.m_boneIds = this->m_boneIds;
+        // after shutdown nothing would ever be uploaded
+        auto &queue = uploadQueue_t::instance();
+        stream->m_generation = queue.generation();
+        if (queue.closed())
+        {
+            stream->m_failed = true;
+            stream->m_done = true;
+            return stream;
+        }
+        this->m_streams.push_back(stream);
+
+        std::weak_ptr<modelStream_t> weak = stream;
+        threadPool_t::instance().submit([weak, file = path.string()]
+                                        {
+            auto converted = std::make_shared<converted_t>();
+            std::vector<std::filesystem::path> files;
+            std::vector<bool> gamma;
+            std::vector<std::size_t> owner; // the mesh of each file
+            std::size_t slice = 1;
+            {
+                // nothing here creates GL objects, so dropping the last reference on this thread is harmless
+                auto s = weak.lock();
+                if (s == nullptr)
+                    return;
+                Assimp::Importer importer;
+                const aiScene *scene = importer.ReadFile(file, importFlags);
+                if (nullptr == scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+                {
+                    std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+                    s->m_failed = true;
+                    s->m_done = true;
+                    return;
+                }
+                s->m_scratch.convertNode(scene->mRootNode, scene, *converted);
+                s->m_total = converted->meshes.size();
+                slice = static_cast<std::size_t>(s->m_scratch.uploadSliceBytes);
+                if (converted->meshes.empty())
+                    s->m_done = true;
+                // the ranges are known now, so the meshes can be uploaded straight into the arenas as they arrive
+                if (s->m_scratch.packArenas)
+                {
+                    for (auto &m : converted->meshes)
+                        if (m.m_vertexCount > 0)
+                            place_arena(s->m_scratch.m_arenas, 0, m);
+                    if (s->m_scratch.m_arenas.empty() == false)
+                        stream_push(weak, [weak]
+                                    {
+                            auto s = weak.lock();
+                            if (s == nullptr)
+                                return;
+                            for (auto &a : s->m_scratch.m_arenas)
+                                create_arena(a); });
+                }
+                for (std::size_t i = 0; i < converted->textures.size(); i++)
+                    for (auto &r : converted->textures[i])
                     {
-                    case vertexType_t::POSITION_ENU:
-                        v.Position = m;
-                        break;
-                    case vertexType_t::NORMAL_ENU:
-                        v.Normal = m;
-                        break;
-                    case vertexType_t::TEXCOORD_ENU:
-                        v.TexCoords = m.head(2);
-                        break;
-                    case vertexType_t::TANGENT_ENU:
-                        v.Tangent = m;
-                        break;
-                    case vertexType_t::BITTANGENT_ENU:
-                        v.Bitangent = m;
-                        break;
-                    default:
-                        break;
+                        files.push_back(std::filesystem::path(s->m_scratch.directory) / r.first);
+                        gamma.push_back(s->m_scratch.srgb(r.second));
+                        owner.push_back(i);
                     }
-                }
-                vertices.push_back(v);
             }
-        }
 
-        std::vector<mesh_t::texture_t> textures;
-        {
-            auto aiTextureType_to_str = [](aiTextureType type_) -> std::string
+            // from here on only the upload jobs lock the stream, so it is released on the render thread.
+            // every mesh is a chain of jobs: create its own buffers, fill them slice by slice, hand it over
+            auto uploadMesh = [weak, converted, slice](std::size_t i)
             {
-                switch (type_)
+                // the mesh stays in converted until its last slice, buffers it already has are released here on the GL thread
+                auto locked = [weak, converted, i]
                 {
-                case aiTextureType_DIFFUSE:
-                    return "texture_diffuse";
-                    break;
-                case aiTextureType_SPECULAR:
-                    return "texture_specular";
-                    break;
-                case aiTextureType_HEIGHT:
-                    return "texture_normal";
-                    break;
-                case aiTextureType_AMBIENT:
-                    return "texture_height";
-                    break;
-                default:
-                    return "";
-                }
+                    auto s = weak.lock();
+                    if (s == nullptr)
+                        converted->meshes[i] = mesh_t();
+                    return s;
+                };
+                const auto &staged = converted->staged[i];
+                if (converted->meshes[i].in_arena() == false)
+                    stream_push(weak, [locked, converted, i]
+                                {
+                        if (locked() == nullptr)
+                            return;
+                        auto &m = converted->meshes[i];
+                        m.upload(nullptr, static_cast<GLsizeiptr>(converted->staged[i].vertices.size()),
+                                 nullptr, static_cast<GLsizeiptr>(converted->staged[i].indices.size())); });
+                // (index buffer, offset into the staged bytes, bytes)
+                auto slices = [&](bool index, std::size_t bytes)
+                {
+                    for (std::size_t at = 0; at < bytes; at += slice)
+                        stream_push(weak, [locked, converted, i, index, at, len = std::min(slice, bytes - at)]
+                                    {
+                            auto s = locked();
+                            if (s == nullptr)
+                                return;
+                            auto &m = converted->meshes[i];
+                            auto &staged = converted->staged[i];
+                            GLuint buffer;
+                            GLintptr base = 0;
+                            if (m.in_arena())
+                            {
+                                auto &a = s->m_scratch.m_arenas[m.m_arena];
+                                buffer = index ? a.ebo : a.vbo;
+                                base = index ? m.m_firstIndex : m.m_baseVertex * static_cast<GLintptr>(a.stride);
+                            }
+                            else
+                                buffer = index ? m.EBO : m.VBO;
+                            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                            glBufferSubData(GL_COPY_WRITE_BUFFER, base + static_cast<GLintptr>(at), static_cast<GLsizeiptr>(len),
+                                            (index ? staged.indices.data() : staged.vertices.data()) + at);
+                            glBindBuffer(GL_COPY_WRITE_BUFFER, 0); });
+                };
+                slices(false, staged.vertices.size());
+                slices(true, staged.indices.size());
+                stream_push(weak, [locked, converted, i]
+                            {
+                    auto s = locked();
+                    if (s == nullptr)
+                        return;
+                    auto &m = converted->meshes[i];
+                    if (m.in_arena())
+                        m.m_drawVao = s->m_scratch.m_arenas[m.m_arena].vao;
+                    // the buffers are filled, uploadConverted only adds the textures and frees the staged copies
+                    s->m_scratch.uploadConverted(*converted, i, false);
+                    mesh_t::staged_t().vertices.swap(converted->staged[i].vertices);
+                    mesh_t::staged_t().indices.swap(converted->staged[i].indices);
+                    s->m_ready.push_back(std::move(s->m_scratch.meshes.back()));
+                    s->m_scratch.meshes.pop_back();
+                    if (++s->m_uploaded == s->m_total)
+                        s->m_done = true; });
             };
-            //todo check whether already loaded in textures_loaded
-            for (auto &&text : _texturesNative)
-            {
-                mesh_t::texture_t t;
-                t.type = aiTextureType_to_str(std::get<0>(text));
-                auto pth = std::filesystem::path(std::get<1>(text));
-                t.path = pth.string();
-                if (std::filesystem::is_directory(pth))
+
+            // textures in batches of a quarter of the staging budget: mapped by a GL job, decoded here on the pool, finished by
+            // another GL job, so the GL thread never decodes. At most stagingBytes are mapped at once, a finished batch makes
+            // room for the next. Each mesh is queued as soon as its own textures are there.
+            auto all = textureRegistry_t::instance().prepare(files, gamma);
+            auto state = std::make_shared<streamTextures_t>();
+            state->missing.resize(converted->meshes.size());
+            state->upload = uploadMesh;
+            // batches in flight do not see each other, so every file goes into one of them only
+            textureRegistry_t::batch_t unique;
+            std::unordered_set<std::string> keys;
+            for (std::size_t k = 0; k < all.items.size(); k++)
+            {
+                auto &item = all.items[k];
+                // files loaded already are held by the batches too, but nothing waits for them
+                if (item.texture == nullptr)
                 {
-                    std::cout << t.path << ": is a directory. not a valid filepath" << std::endl;
-                    continue;
+                    // the files of a mesh are next to each other, a mesh waits once for a file it uses twice
+                    auto &waiters = state->waiters[item.key];
+                    if (waiters.empty() || waiters.back() != owner[k])
+                    {
+                        waiters.push_back(owner[k]);
+                        state->missing[owner[k]]++;
+                    }
                 }
-                t.id = this->TextureFromFile(pth.filename().string(), pth.parent_path().string());
-                textures.push_back(t);
+                if (keys.insert(item.key).second)
+                    unique.items.push_back(std::move(item));
             }
-        }
+            for (std::size_t i = 0; i < converted->meshes.size(); i++)
+                if (state->missing[i] == 0)
+                    uploadMesh(i);
+            for (auto &batch : textureRegistry_t::split(std::move(unique), textureRegistry_t::stagingBytes / 4))
+                state->waiting.push_back(std::make_shared<textureRegistry_t::batch_t>(std::move(batch)));
+            if (state->waiting.empty() == false)
+                stream_push(weak, [weak, state]
+                            { stream_textures(weak, state); });
+        });
+        return stream;
+    }
 
-        auto mesh = mesh_t(vertices, _indices, textures);
-        this->meshes.push_back(mesh);
-        return true;
-    };
+    void model_t::stream_textures(const std::weak_ptr<modelStream_t> &weak, const std::shared_ptr<streamTextures_t> &state)
+    {
+        // batches never mapped hold handles only, release them here on the GL thread
+        if (weak.expired())
+        {
+            state->waiting.clear();
+            return;
+        }
+        // a batch larger than the budget still goes, alone
+        while (state->waiting.empty() == false &&
+               (state->mapped == 0 || state->mapped + state->waiting.front()->bytes <= textureRegistry_t::stagingBytes))
+        {
+            auto batch = std::move(state->waiting.front());
+            state->waiting.pop_front();
+            state->mapped += batch->bytes;
+            textureRegistry_t::instance().map(*batch);
+            // the batch owns a PBO, every step hands its references on so that the last one is dropped on the GL thread
+            threadPool_t::instance().submit([weak, state = state, batch = std::move(batch)]() mutable
+                                            {
+                textureRegistry_t::decode(*batch);
+                stream_push(weak, [weak, state = std::move(state), batch = std::move(batch)]
+                            {
+                    textureRegistry_t::instance().finish(*batch);
+                    state->mapped -= batch->bytes;
+                    auto s = weak.lock();
+                    if (s == nullptr)
+                    {
+                        state->waiting.clear();
+                        return;
+                    }
+                    for (auto &item : batch->items)
+                    {
+                        s->m_prefetched.push_back(item.texture);
+                        auto waiters = state->waiters.find(item.key);
+                        if (waiters == state->waiters.end())
+                            continue;
+                        for (auto i : waiters->second)
+                            if (--state->missing[i] == 0)
+                                state->upload(i);
+                        state->waiters.erase(waiters);
+                    }
+                    stream_textures(weak, state); }); });
+        }
+    }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats
-    // this process on its children nodes (if any).
-    void model_t::processNode(aiNode *node, const aiScene *scene)
+    bool model_t::stream_push(const std::weak_ptr<modelStream_t> &weak, std::function<void()> task)
     {
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
+        if (uploadQueue_t::instance().push(std::move(task)))
+            return true;
+        // pool tasks finish before the queue closes, so this only runs on the thread that shut it down
+        if (auto s = weak.lock())
         {
-            // the node object only contains indices to index the actual objects in the scene.
-            // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            s->m_failed = true;
+            s->m_done = true;
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
+        return false;
+    }
+
+    void model_t::adoptStreams()
+    {
+        for (auto iter = this->m_streams.begin(); iter != this->m_streams.end();)
         {
-            processNode(node->mChildren[i], scene);
+            auto &s = **iter;
+            // the ready list is only touched on the render thread, like Draw.
+            // meshes in an arena of the stream are drawn one by one from it until the load completes
+            for (auto &m : s.m_ready)
+            {
+                if (m.in_arena())
+                    s.m_placed.emplace_back(this->meshes.size(), m.m_arena);
+                m.m_arena = -1;
+                this->meshes.push_back(std::move(m));
+            }
+            s.m_ready.clear();
+            // a cancel dropped the rest of its jobs, what arrived so far is kept
+            if (s.m_done == false && s.m_generation != uploadQueue_t::instance().generation())
+            {
+                s.m_failed = true;
+                s.m_done = true;
+            }
+            if (s.m_done == false)
+            {
+                ++iter;
+                continue;
+            }
+
+            // the load is complete: its textures, bones and arenas belong to the model from now on
+            auto &scratch = s.m_scratch;
+            const auto base = this->m_arenas.size();
+            for (auto &a : scratch.m_arenas)
+                this->m_arenas.push_back(std::move(a));
+            scratch.m_arenas.clear();
+            for (auto &[i, k] : s.m_placed)
+            {
+                this->meshes[i].m_arena = static_cast<int>(base + k);
+                this->m_arenas[base + k].meshes.push_back(i);
+            }
+            for (auto &t : scratch.textures_loaded)
+                if (this->m_textures.emplace(t.id, scratch.m_textures[t.id]).second)
+                    this->textures_loaded.push_back(t);
+            for (auto &t : scratch.m_textures)
+                this->m_textures.emplace(t.first, std::move(t.second));
+            scratch.m_textures.clear();
+            for (auto &b : scratch.m_OffsetMatMap)
+                this->m_OffsetMatMap.emplace(b.first, b.second);
+            this->m_BoneCount = std::max(this->m_BoneCount, scratch.m_BoneCount);
+            iter = this->m_streams.erase(iter);
         }
     }
 
@@ -1083,20 +6488,18 @@ namespace shaders
         // }
     }
 
-    mesh_t model_t::processMesh(aiMesh *mesh, const aiScene *scene)
+    void model_t::processMesh(aiMesh *mesh, const aiScene *scene, mesh_t &out, mesh_t::staged_t &staged)
     {
-        std::vector<mesh_t::vertex_t> vertices;
-        std::vector<unsigned int> indices;
-        std::vector<mesh_t::texture_t> textures;
-
         auto getVec = [](const aiVector3D &vec) -> Eigen::Vector3f
         {
             return Eigen::Vector3f(vec.x, vec.y, vec.z);
         };
 
+        // sized up front and written in place
+        std::vector<mesh_t::vertex_t> vertices(mesh->mNumVertices);
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            mesh_t::vertex_t vertex;
+            mesh_t::vertex_t &vertex = vertices[i];
             SetVertexBoneDataToDefault(vertex);
             vertex.Position = getVec(mesh->mVertices[i]);
             vertex.Normal = getVec(mesh->mNormals[i]);
@@ -1110,29 +6513,65 @@ namespace shaders
             {
                 vertex.TexCoords << 0.0f, 0.0f;
             }
-            vertices.push_back(vertex);
         }
+
+        std::size_t count = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            count += mesh->mFaces[i].mNumIndices;
+        std::vector<GLuint> indices(count);
+        auto dst = indices.begin();
         for (unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
-            for (unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            const aiFace &face = mesh->mFaces[i];
+            dst = std::copy(face.mIndices, face.mIndices + face.mNumIndices, dst);
         }
 
-        aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+        ExtractBoneWeightForVertices(vertices, mesh, scene);
+
+        out.m_cacheReport = this->optimize_mesh(vertices, indices);
+        out.vertices = std::move(vertices);
+        out.indices = std::move(indices);
+        staged = out.stage(this->vertexFormat);
+    }
 
-        std::vector<mesh_t::texture_t> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        std::vector<mesh_t::texture_t> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        std::vector<mesh_t::texture_t> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        std::vector<mesh_t::texture_t> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    model_t::textureRefs_t model_t::materialTextureRefs(aiMaterial *material)
+    {
+        textureRefs_t refs;
+        this->materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", refs);
+        this->materialTextures(material, aiTextureType_SPECULAR, "texture_specular", refs);
+        this->materialTextures(material, aiTextureType_HEIGHT, "texture_normal", refs);
+        this->materialTextures(material, aiTextureType_AMBIENT, "texture_height", refs);
+        return refs;
+    }
 
-        ExtractBoneWeightForVertices(vertices, mesh, scene);
+    meshopt::weldReport_t model_t::weld_mesh(const void *vertices, std::size_t count, std::size_t stride,
+                                             const vertexFormat_t::attrib_t *attribs, std::size_t nattribs,
+                                             std::vector<unsigned char> &rows, std::vector<GLuint> &indices)
+    {
+        if (count == 0 || std::any_of(indices.begin(), indices.end(), [&](GLuint i)
+                                      { return i >= count; }))
+            return {};
+
+        std::vector<GLuint> remap;
+        auto report = meshopt::weld(vertices, count, stride, attribs, nattribs, this->weldEpsilon, rows, remap);
+        // unindexed input draws its vertices in order, the remap is the index buffer
+        if (indices.empty())
+            indices = std::move(remap);
+        else
+            for (auto &i : indices)
+                i = remap[i];
+        return report;
+    }
 
-        return mesh_t(vertices, indices, textures);
+    meshopt::report_t model_t::optimize_mesh(std::vector<mesh_t::vertex_t> &vertices, std::vector<GLuint> &indices)
+    {
+        if (this->meshOptimization == false || vertices.empty() || indices.empty())
+            return {};
+        auto count = vertices.size();
+        auto position = reinterpret_cast<const unsigned char *>(&vertices[0].Position) - reinterpret_cast<const unsigned char *>(&vertices[0]);
+        auto report = meshopt::optimize(vertices.data(), count, sizeof(mesh_t::vertex_t), position, indices);
+        vertices.resize(count);
+        return report;
     }
 
     void model_t::SetVertexBoneData(mesh_t::vertex_t &vertex, int boneID, float weight)
@@ -1149,29 +6588,46 @@ namespace shaders
         // }
     }
 
-    void model_t::ExtractBoneWeightForVertices(std::vector<mesh_t::vertex_t> &vertices, aiMesh *mesh, const aiScene *scene)
+    void model_t::registerBones(aiMesh *mesh)
     {
-        auto &boneInfoMap = m_OffsetMatMap;
-        int &boneCount = m_BoneCount;
-
-        for (int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
+        for (unsigned int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
         {
-            int boneID = -1;
             std::string boneName = mesh->mBones[boneIndex]->mName.C_Str();
-            if (boneInfoMap.find(boneName) == boneInfoMap.end())
+            if (m_OffsetMatMap.find(boneName) == m_OffsetMatMap.end())
             {
                 boneInfo_t newBoneInfo;
-                newBoneInfo.id = boneCount;
+                newBoneInfo.id = this->bone_id(boneName);
                 newBoneInfo.offset = assimp_helper::ConvertAiMatrixToEigenFormat(mesh->mBones[boneIndex]->mOffsetMatrix);
-                boneInfoMap[boneName] = newBoneInfo;
-                boneID = boneCount;
-                boneCount++;
-            }
-            else
-            {
-                boneID = boneInfoMap[boneName].id;
+                m_OffsetMatMap[boneName] = newBoneInfo;
+                m_BoneCount = std::max(m_BoneCount, newBoneInfo.id + 1);
             }
-            assert(boneID != -1);
+        }
+    }
+
+    int model_t::bone_id(const std::string &name)
+    {
+        // a moved-from model starts over with a table of its own
+        if (this->m_boneIds == nullptr)
+            this->m_boneIds = std::make_shared<boneIds_t>();
+        auto &table = *this->m_boneIds;
+        std::lock_guard<std::mutex> lock(table.mutex);
+        auto iter = table.ids.emplace(name, table.count);
+        if (iter.second)
+            table.count++;
+        return iter.first->second;
+    }
+
+    void model_t::ExtractBoneWeightForVertices(std::vector<mesh_t::vertex_t> &vertices, aiMesh *mesh, const aiScene *scene)
+    {
+        // registerBones already filled the table, only find() here so that meshes can be converted concurrently
+        const auto &boneInfoMap = m_OffsetMatMap;
+
+        for (int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
+        {
+            std::string boneName = mesh->mBones[boneIndex]->mName.C_Str();
+            auto iter = boneInfoMap.find(boneName);
+            assert(iter != boneInfoMap.end());
+            int boneID = iter->second.id;
             auto weights = mesh->mBones[boneIndex]->mWeights;
             int numWeights = mesh->mBones[boneIndex]->mNumWeights;
 
@@ -1185,80 +6641,571 @@ namespace shaders
         }
     }
 
-    unsigned int model_t::TextureFromFile(const std::string &filename,
-                                          const std::string &directory, bool gamma)
+    textureRegistry_t &textureRegistry_t::instance()
     {
-        auto path = std::filesystem::path(directory);
-        path /= filename;
+        static textureRegistry_t registry;
+        return registry;
+    };
+
+    textureRegistry_t::handle_t textureRegistry_t::find(const std::string &key)
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        auto iter = this->m_textures.find(key);
+        if (iter == this->m_textures.end())
+            return nullptr;
+        auto texture = iter->second.lock();
+        if (texture != nullptr)
+            this->m_hits++;
+        return texture;
+    }
+
+    std::string textureRegistry_t::key_of(const std::filesystem::path &file, bool gamma)
+    {
+        // one entry per file however it is spelled, and per set of load parameters
+        std::error_code ec;
+        auto canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(file, ec), ec);
+        return (ec ? file : canonical).string() + (gamma ? "|srgb" : "|linear");
+    }
+
+    std::filesystem::path textureRegistry_t::cooked_file(const std::filesystem::path &file, bool gamma)
+    {
+        // relative to the content root, so that a cache cooked offline still matches after the content moved.
+        // generic form: the same name on every platform
+        std::error_code ec;
+        auto canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(file, ec), ec);
+        if (ec)
+            canonical = file;
+        auto root = std::filesystem::weakly_canonical(std::filesystem::absolute(content_root(), ec), ec);
+        auto relative = canonical.lexically_relative(root);
+        const bool inside = !ec && root.empty() == false && relative.empty() == false && *relative.begin() != "..";
+        const auto key = (inside ? relative : canonical).generic_string() + (gamma ? "|srgb" : "|linear");
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.gltex", static_cast<unsigned long long>(fnv1a(key)));
+        return cache_root() / "textures" / name;
+    }
+
+    GLenum textureRegistry_t::pixel_format(int components)
+    {
+        switch (components)
+        {
+        case 2:
+            return GL_RG;
+        case 3:
+            return GL_RGB;
+        case 4:
+            return GL_RGBA;
+        default:
+            return GL_RED;
+        }
+    }
+
+    GLenum textureRegistry_t::internal_format(int components, bool gamma)
+    {
+        // sized, glTexStorage2D accepts nothing else
+        switch (components)
+        {
+        case 2:
+            return GL_RG8;
+        case 3:
+            return gamma ? GL_SRGB8 : GL_RGB8;
+        case 4:
+            return gamma ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        default:
+            return GL_R8;
+        }
+    }
+
+    int textureRegistry_t::mip_levels(int width, int height)
+    {
+        int levels = 1;
+        for (int size = std::max(width, height); size > 1; size >>= 1)
+            levels++;
+        return levels;
+    }
+
+    std::size_t textureRegistry_t::level_bytes(int width, int height, int components, int level)
+    {
+        return std::size_t(std::max(1, width >> level)) * std::max(1, height >> level) * components;
+    }
 
-        unsigned int textureID;
-        glGenTextures(1, &textureID);
+    std::size_t textureRegistry_t::chain_bytes(int width, int height, int components, int levels)
+    {
+        std::size_t bytes = 0;
+        for (int l = 0; l < levels; l++)
+            bytes += level_bytes(width, height, components, l);
+        return bytes;
+    }
 
-        int width, height, nrComponents;
-        unsigned char *data = stbi_load(path.string().c_str(), &width, &height, &nrComponents, 0);
-        if (data)
+    bool textureRegistry_t::storage_supported()
+    {
+        static const bool supported = []
         {
-            GLenum format;
-            if (nrComponents == 1)
-                format = GL_RED;
-            else if (nrComponents == 3)
-                format = GL_RGB;
-            else if (nrComponents == 4)
-                format = GL_RGBA;
+            GLint major = 0, minor = 0;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            return major > 4 || (major == 4 && minor >= 2) || has_extension("GL_ARB_texture_storage");
+        }();
+        return supported;
+    }
 
-            glBindTexture(GL_TEXTURE_2D, textureID);
-            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
+    bool textureRegistry_t::cooked_header(const std::filesystem::path &file, bool gamma, cookedHeader_t &hdr)
+    {
+        auto cooked = cooked_file(file, gamma);
+        std::error_code ec;
+        auto cookedTime = std::filesystem::last_write_time(cooked, ec);
+        if (ec)
+            return false;
+        // a cooked file may ship without its source
+        auto sourceTime = std::filesystem::last_write_time(file, ec);
+        if (!ec && cookedTime < sourceTime)
+            return false;
+
+        std::ifstream in(cooked, std::ios::binary);
+        if (!in.read(reinterpret_cast<char *>(&hdr), sizeof(hdr)))
+            return false;
+        return std::memcmp(hdr.magic, "MGLTEX", 7) == 0 && hdr.version == COOKED_VERSION &&
+               hdr.components >= 1 && hdr.components <= 4 && hdr.width > 0 && hdr.height > 0 &&
+               hdr.width <= (1u << 16) && hdr.height <= (1u << 16) &&
+               hdr.levels == static_cast<std::uint32_t>(mip_levels(hdr.width, hdr.height)) &&
+               hdr.internalFormat == internal_format(hdr.components, gamma);
+    }
+
+    std::vector<unsigned char> textureRegistry_t::build_mips(const unsigned char *pixels, int width, int height, int components, bool gamma)
+    {
+        const int levels = mip_levels(width, height);
+        std::vector<unsigned char> chain(chain_bytes(width, height, components, levels));
+        std::memcpy(chain.data(), pixels, level_bytes(width, height, components, 0));
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // sRGB colour channels are averaged as linear light, alpha always is linear
+        static const auto toLinear = []
+        {
+            std::array<float, 256> table;
+            for (int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return table;
+        }();
+        auto toSrgb = [](float l)
+        {
+            float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+            return static_cast<unsigned char>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+        };
 
-            stbi_image_free(data);
+        std::size_t srcOffset = 0;
+        for (int l = 1; l < levels; l++)
+        {
+            const int sw = std::max(1, width >> (l - 1)), sh = std::max(1, height >> (l - 1));
+            const int dw = std::max(1, width >> l), dh = std::max(1, height >> l);
+            const unsigned char *src = chain.data() + srcOffset;
+            unsigned char *dst = chain.data() + srcOffset + level_bytes(width, height, components, l - 1);
+            for (int y = 0; y < dh; y++)
+            {
+                // a side of 1 is not halved any more, its texels are used twice
+                const int y0 = std::min(2 * y, sh - 1), y1 = std::min(2 * y + 1, sh - 1);
+                for (int x = 0; x < dw; x++)
+                {
+                    const int x0 = std::min(2 * x, sw - 1), x1 = std::min(2 * x + 1, sw - 1);
+                    const unsigned char *p[4] = {src + (std::size_t(y0) * sw + x0) * components, src + (std::size_t(y0) * sw + x1) * components,
+                                                 src + (std::size_t(y1) * sw + x0) * components, src + (std::size_t(y1) * sw + x1) * components};
+                    for (int c = 0; c < components; c++)
+                    {
+                        auto &out = dst[(std::size_t(y) * dw + x) * components + c];
+                        if (gamma && c < 3)
+                            out = toSrgb((toLinear[p[0][c]] + toLinear[p[1][c]] + toLinear[p[2][c]] + toLinear[p[3][c]]) * 0.25f);
+                        else
+                            out = static_cast<unsigned char>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+                    }
+                }
+            }
+            srcOffset += level_bytes(width, height, components, l - 1);
         }
-        else
+        return chain;
+    }
+
+    bool textureRegistry_t::write_cooked(const std::filesystem::path &file, bool gamma, int width, int height, int components,
+                                         const std::vector<unsigned char> &chain)
+    {
+        cookedHeader_t hdr{};
+        std::memcpy(hdr.magic, "MGLTEX", 7);
+        hdr.version = COOKED_VERSION;
+        hdr.internalFormat = internal_format(components, gamma);
+        hdr.format = pixel_format(components);
+        hdr.type = GL_UNSIGNED_BYTE;
+        hdr.width = width;
+        hdr.height = height;
+        hdr.components = components;
+        hdr.levels = mip_levels(width, height);
+
+        // level index right after the header, then every level 16 byte aligned
+        std::vector<cookedLevel_t> index(hdr.levels);
+        std::uint64_t at = sizeof(hdr) + sizeof(cookedLevel_t) * index.size();
+        for (std::uint32_t l = 0; l < hdr.levels; l++)
         {
-            std::cout << "Texture failed to load at path: " << path << std::endl;
-            stbi_image_free(data);
+            at = (at + 15) & ~std::uint64_t(15);
+            index[l] = {at, level_bytes(width, height, components, l)};
+            at += index[l].bytes;
         }
 
-        return textureID;
+        std::error_code ec;
+        auto path = cooked_file(file, gamma);
+        std::filesystem::create_directories(path.parent_path(), ec);
+        // write to a temporary name first, concurrent processes must never map a half written file
+        auto tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+            if (f.fail())
+                return false;
+            f.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+            f.write(reinterpret_cast<const char *>(index.data()), sizeof(cookedLevel_t) * index.size());
+            const char zeros[16] = {};
+            std::uint64_t written = sizeof(hdr) + sizeof(cookedLevel_t) * index.size();
+            std::size_t from = 0;
+            for (auto &level : index)
+            {
+                f.write(zeros, level.offset - written);
+                f.write(reinterpret_cast<const char *>(chain.data() + from), level.bytes);
+                from += level.bytes;
+                written = level.offset + level.bytes;
+            }
+            if (f.fail())
+                return false;
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    std::vector<mesh_t::texture_t> model_t::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
+    bool textureRegistry_t::cook(const std::filesystem::path &file, bool gamma)
     {
-        std::vector<mesh_t::texture_t> textures;
-        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        int width, height, components;
+        unsigned char *data = stbi_load(file.string().c_str(), &width, &height, &components, 0);
+        if (data == nullptr)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
+            std::cout << "Texture failed to load at path: " << file << std::endl;
+            return false;
+        }
+        auto chain = build_mips(data, width, height, components, gamma);
+        stbi_image_free(data);
+        return write_cooked(file, gamma, width, height, components, chain);
+    }
+
+    textureRegistry_t::batch_t textureRegistry_t::prepare(const std::vector<std::filesystem::path> &files, const std::vector<bool> &gamma)
+    {
+        batch_t batch;
+        batch.items.resize(files.size());
+        for (std::size_t i = 0; i < files.size(); i++)
+        {
+            auto &item = batch.items[i];
+            item.file = files[i];
+            item.gamma = i < gamma.size() && gamma[i];
+            item.key = key_of(files[i], item.gamma);
+            item.texture = this->find(item.key);
+        }
+
+        // the headers tell the staging size, reading them is file I/O as well
+        threadPool_t::instance().parallel_for(batch.items.size(), [&](std::size_t begin, std::size_t end)
+                                              {
+                                                  for (std::size_t i = begin; i < end; i++)
+                                                  {
+                                                      auto &item = batch.items[i];
+                                                      if (item.texture != nullptr)
+                                                          continue;
+                                                      cookedHeader_t hdr;
+                                                      if (cooked_header(item.file, item.gamma, hdr))
+                                                      {
+                                                          item.cooked = true;
+                                                          item.width = hdr.width;
+                                                          item.height = hdr.height;
+                                                          item.components = hdr.components;
+                                                      }
+                                                      else if (stbi_info(item.file.string().c_str(), &item.width, &item.height, &item.components) == 0)
+                                                          item.width = item.height = item.components = 0;
+                                                      item.levels = item.width > 0 ? mip_levels(item.width, item.height) : 0;
+                                                  } },
+                                              1);
+        return batch;
+    }
+
+    void textureRegistry_t::map(batch_t &batch)
+    {
+        // files loaded since prepare, e.g. by another batch, and repeated files are not staged again
+        std::unordered_map<std::string, std::size_t> first;
+        std::size_t bytes = 0;
+        for (std::size_t i = 0; i < batch.items.size(); i++)
+        {
+            auto &item = batch.items[i];
+            if (item.texture == nullptr)
+                item.texture = this->find(item.key);
+            if (item.texture != nullptr)
+                continue;
+            auto known = first.emplace(item.key, i);
+            if (known.second == false)
+            {
+                item.alias = static_cast<std::ptrdiff_t>(known.first->second);
+                continue;
+            }
+            item.offset = bytes;
+            bytes += (chain_bytes(item.width, item.height, item.components, item.levels) + 15) & ~std::size_t(15);
+        }
+        if (bytes == 0)
+            return;
+
+        batch.pbo = glBuffer_t::create();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, batch.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_DRAW);
+        batch.mapped = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes),
+                                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (batch.mapped == nullptr)
+            std::cout << "cannot map " << bytes << " bytes of texture staging memory" << std::endl;
+    }
+
+    void textureRegistry_t::decode(batch_t &batch)
+    {
+        if (batch.mapped == nullptr)
+            return;
+        auto &registry = instance();
+        threadPool_t::instance().parallel_for(batch.items.size(), [&](std::size_t begin, std::size_t end)
+                                              {
+                                                  for (std::size_t i = begin; i < end; i++)
+                                                  {
+                                                      auto &item = batch.items[i];
+                                                      if (item.texture != nullptr || item.alias >= 0 || item.width == 0)
+                                                          continue;
+                                                      unsigned char *staging = batch.mapped + item.offset;
+
+                                                      // cooked: the level index tells where each level is, nothing to decode
+                                                      if (item.cooked)
+                                                      {
+                                                          mappedFile_t file(cooked_file(item.file, item.gamma));
+                                                          cookedHeader_t hdr;
+                                                          bool ok = file.valid() && file.size() >= sizeof(hdr) + sizeof(cookedLevel_t) * item.levels;
+                                                          if (ok)
+                                                          {
+                                                              std::memcpy(&hdr, file.data(), sizeof(hdr));
+                                                              ok = hdr.width == static_cast<std::uint32_t>(item.width) && hdr.height == static_cast<std::uint32_t>(item.height) &&
+                                                                   hdr.components == static_cast<std::uint32_t>(item.components) && hdr.levels == static_cast<std::uint32_t>(item.levels);
+                                                          }
+                                                          std::size_t to = 0;
+                                                          for (int l = 0; ok && l < item.levels; l++)
+                                                          {
+                                                              cookedLevel_t level;
+                                                              std::memcpy(&level, file.data() + sizeof(hdr) + sizeof(level) * l, sizeof(level));
+                                                              ok = level.bytes == level_bytes(item.width, item.height, item.components, l) &&
+                                                                   level.offset <= file.size() && level.bytes <= file.size() - level.offset;
+                                                              if (ok)
+                                                                  std::memcpy(staging + to, file.data() + level.offset, level.bytes);
+                                                              to += level.bytes;
+                                                          }
+                                                          if (ok)
+                                                          {
+                                                              item.decoded = true;
+                                                              registry.m_cookedLoads++;
+                                                              continue;
+                                                          }
+                                                          // corrupt or replaced meanwhile, the source is tried below and cooked again
+                                                          item.cooked = false;
+                                                      }
+
+                                                      // stb_image allocates its own output, the copy goes straight to the driver's memory
+                                                      int width, height, components;
+                                                      unsigned char *data = stbi_load(item.file.string().c_str(), &width, &height, &components, 0);
+                                                      if (data != nullptr && width == item.width && height == item.height && components == item.components)
+                                                      {
+                                                          auto chain = build_mips(data, width, height, components, item.gamma);
+                                                          std::memcpy(staging, chain.data(), chain.size());
+                                                          item.decoded = true;
+                                                          if (registry.cooking && write_cooked(item.file, item.gamma, width, height, components, chain) == false)
+                                                              std::cout << item.file << ": cannot write the cooked texture to " << cooked_file(item.file, item.gamma) << std::endl;
+                                                      }
+                                                      stbi_image_free(data);
+                                                  } },
+                                              1);
+    }
+
+    void textureRegistry_t::finish(batch_t &batch)
+    {
+        bool staged = true;
+        if (batch.mapped != nullptr)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, batch.pbo);
+            // the content is undefined when the mapping was lost, e.g. on a mode switch
+            staged = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+            batch.mapped = nullptr;
+        }
+
+        {
+            // entries of textures released since the last batch, the table stays as large as what is alive
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            for (auto iter = this->m_textures.begin(); iter != this->m_textures.end();)
+                iter = iter->second.expired() ? this->m_textures.erase(iter) : std::next(iter);
+        }
+
+        GLint alignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (auto &item : batch.items)
+        {
+            if (item.texture != nullptr)
+                continue;
+            if (item.alias >= 0)
+            {
+                item.texture = batch.items[item.alias].texture;
+                continue;
+            }
+
+            unsigned int textureID;
+            glGenTextures(1, &textureID);
+            if (item.decoded && staged)
             {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                const GLenum format = pixel_format(item.components);
+                const GLenum internalFormat = internal_format(item.components, item.gamma);
+
+                // storage first: with the PBO bound a null pointer would mean offset 0
+                glBindTexture(GL_TEXTURE_2D, textureID);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                if (storage_supported())
+                    glTexStorage2D(GL_TEXTURE_2D, item.levels, internalFormat, item.width, item.height);
+                else
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
+                    for (int l = 0; l < item.levels; l++)
+                        glTexImage2D(GL_TEXTURE_2D, l, internalFormat, std::max(1, item.width >> l), std::max(1, item.height >> l), 0,
+                                     format, GL_UNSIGNED_BYTE, nullptr);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, item.levels - 1);
+                }
+                // the whole chain is staged, no glGenerateMipmap
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, batch.pbo);
+                std::size_t offset = item.offset;
+                for (int l = 0; l < item.levels; l++)
+                {
+                    glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, std::max(1, item.width >> l), std::max(1, item.height >> l),
+                                    format, GL_UNSIGNED_BYTE, (void *)offset);
+                    offset += level_bytes(item.width, item.height, item.components, l);
                 }
+
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             }
-            if (!skip)
-            { // if texture hasn't been loaded already, load it
-                mesh_t::texture_t texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture); // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+            else
+                std::cout << "Texture failed to load at path: " << item.file << std::endl;
+
+            auto texture = std::make_shared<const glTexture_t>(textureID);
+            {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                auto &entry = this->m_textures[item.key];
+                // another batch may have finished the same file meanwhile, the first one wins
+                if (auto other = entry.lock())
+                    texture = std::move(other);
+                else
+                {
+                    entry = texture;
+                    this->m_misses++;
+                }
             }
+            item.texture = std::move(texture);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        batch.pbo.reset();
+    }
+
+    std::vector<textureRegistry_t::batch_t> textureRegistry_t::split(batch_t &&all, std::size_t budget)
+    {
+        std::vector<batch_t> batches;
+        for (auto &item : all.items)
+        {
+            // as map lays them out; files loaded already take no staging
+            const auto bytes = item.texture != nullptr ? 0 : (chain_bytes(item.width, item.height, item.components, item.levels) + 15) & ~std::size_t(15);
+            if (batches.empty() || (batches.back().items.empty() == false && batches.back().bytes + bytes > budget))
+                batches.emplace_back();
+            batches.back().items.push_back(std::move(item));
+            batches.back().bytes += bytes;
+        }
+        return batches;
+    }
+
+    std::vector<textureRegistry_t::handle_t> textureRegistry_t::acquire(const std::vector<std::filesystem::path> &files, const std::vector<bool> &gamma)
+    {
+        // stage at most stagingBytes at a time, later slices find the repeats of earlier ones in the table
+        std::vector<handle_t> textures;
+        textures.reserve(files.size());
+        for (auto &batch : split(this->prepare(files, gamma)))
+        {
+            this->map(batch);
+            decode(batch);
+            this->finish(batch);
+            for (auto &item : batch.items)
+                textures.push_back(std::move(item.texture));
         }
         return textures;
     }
 
+    std::size_t textureRegistry_t::size() const
+    {
+        // expired entries wait for the next finish
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return std::count_if(this->m_textures.begin(), this->m_textures.end(), [](const auto &e)
+                             { return e.second.expired() == false; });
+    }
+
+    unsigned int model_t::TextureFromFile(const std::string &filename,
+                                          const std::string &directory, bool gamma)
+    {
+        auto path = std::filesystem::path(directory);
+        path /= filename;
+
+        auto texture = textureRegistry_t::instance().acquire(path, gamma);
+        GLuint textureID = *texture;
+        this->m_textures.emplace(textureID, std::move(texture));
+        return textureID;
+    }
+
+    std::vector<textureRegistry_t::handle_t> model_t::prefetchTextures(const textureRefs_t &refs)
+    {
+        std::vector<std::filesystem::path> paths;
+        std::vector<bool> gamma;
+        for (auto &[file, type] : refs)
+        {
+            paths.push_back(std::filesystem::path(this->directory) / file);
+            gamma.push_back(this->srgb(type));
+        }
+        return textureRegistry_t::instance().acquire(paths, gamma);
+    }
+
+    // appends the material textures of a given type, they are loaded later by materialTexture
+    void model_t::materialTextures(aiMaterial *mat, aiTextureType type, const std::string &typeName, textureRefs_t &refs)
+    {
+        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            refs.emplace_back(str.C_Str(), typeName);
+        }
+    }
+
+    mesh_t::texture_t model_t::materialTexture(const std::string &file, const std::string &typeName)
+    {
+        // the registry finds a texture loaded before by any model in O(1)
+        mesh_t::texture_t texture;
+        const auto known = this->m_textures.size();
+        texture.id = TextureFromFile(file, this->directory, this->srgb(typeName));
+        texture.type = typeName;
+        texture.path = file;
+        if (this->m_textures.size() > known)
+            textures_loaded.push_back(texture); // first use in this model
+        return texture;
+    }
+
 };
 #endif //#ifdef  MYGLUTILITY__IMPLEMENTATION 
 
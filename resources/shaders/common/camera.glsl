@@ -0,0 +1,7 @@
+#pragma once
+// per-frame camera data, shared by all programs through shaders::uniformBlock_t("Camera", ...)
+layout (std140) uniform Camera
+{
+   mat4 projection;
+   mat4 view;
+};
@@ -0,0 +1,26 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+#ifdef INSTANCED
+in vec4 InstanceColor;
+#endif
+
+// USE_TEXTURE: sample texture1, otherwise the flat `color` uniform
+#ifdef USE_TEXTURE
+uniform sampler2D texture1;
+#else
+uniform vec3 color;
+#endif
+
+void main()
+{
+#ifdef USE_TEXTURE
+   FragColor = texture(texture1, TexCoords);
+#else
+   FragColor = vec4(color, 1.0);
+#endif
+#ifdef INSTANCED
+   FragColor *= InstanceColor;
+#endif
+}
@@ -0,0 +1,27 @@
+#version 330 core
+#include "common/camera.glsl"
+
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoords; // mesh_t attribute locations, see model_t
+
+out vec2 TexCoords;
+
+// INSTANCED: per-instance model matrix and color, see model_t::DrawInstanced
+#ifdef INSTANCED
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in vec4 aInstanceColor;
+out vec4 InstanceColor;
+#else
+uniform mat4 model;
+#endif
+
+void main()
+{
+   TexCoords = aTexCoords;
+#ifdef INSTANCED
+   InstanceColor = aInstanceColor;
+   gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
+#else
+   gl_Position = projection * view * model * vec4(aPos, 1.0);
+#endif
+}
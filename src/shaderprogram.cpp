@@ -1,6 +1,7 @@
 
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <fstream>
 #include <iostream>
@@ -30,90 +31,111 @@ namespace shaders
         return out;
     };
 
-    GLuint create_link_program(std::string &vert_glsl, std::string &frag_glsl)
+    // submit a compile without querying its status, the driver may keep working in its compiler threads
+    static GLuint compile_begin(GLenum type, const std::string &glsl)
     {
-        //helper
-        struct ShaderInfo
-        {
-            GLenum type;
-            std::string shaderstr;
-            GLuint shader;
-        };
-
-        auto LoadShaders = [](std::vector<ShaderInfo> &shaders) -> GLuint {
-            if (shaders.empty() == true)
-                return 0;
-
-            GLuint prog = glCreateProgram();
+        GLuint shader = glCreateShader(type);
+        auto source = glsl.c_str();
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        return shader;
+    };
 
-            for (auto iter = shaders.begin(); iter != shaders.end(); iter++)
-            {
-                if (iter->type == GL_NONE)
-                    continue;
-                iter->shader = glCreateShader(iter->type);
-                // const GLchar *source = entry->shaderstr.data();
-                auto source = iter->shaderstr.c_str();
-                glShaderSource(iter->shader, 1, &source, NULL);
-                glCompileShader(iter->shader);
-
-                // check for shader compile errors
-                GLint success;
-                glGetShaderiv(iter->shader, GL_COMPILE_STATUS, &success);
-                if (!success)
-                {
-                    if constexpr (is_debug == true)
-                    {
-                        GLsizei len;
-                        glGetShaderiv(iter->shader, GL_INFO_LOG_LENGTH, &len);
-
-                        GLchar *log = new GLchar[len + 1];
-                        glGetShaderInfoLog(iter->shader, len, &len, log);
-                        std::cerr << "Shader compilation failed: " << log << std::endl;
-                        delete[] log;
-                    }
-
-                    return 0;
-                }
-                // attach shaders
-                glAttachShader(prog, iter->shader);
-            }
+    // link the shaders from compile_begin, again without querying any status
+    static GLuint link_begin(const std::array<GLuint, 2> &shaders)
+    {
+        GLuint prog = glCreateProgram();
+        for (auto shader : shaders)
+            glAttachShader(prog, shader);
+        glLinkProgram(prog);
+        return prog;
+    };
 
-            // link shaders
-            glLinkProgram(prog);
+    // check compile/link status of a program from link_begin, release its shaders.
+    // return prog, or 0 (prog deleted) on failure
+    static GLuint link_end(GLuint prog)
+    {
+        GLuint shaders[2];
+        GLsizei count = 0;
+        glGetAttachedShaders(prog, 2, &count, shaders);
 
-            // check for linking errors
-            GLint linked;
-            glGetProgramiv(prog, GL_LINK_STATUS, &linked);
-            if (!linked)
+        bool ok = true;
+        for (GLsizei i = 0; i < count; i++)
+        {
+            // check for shader compile errors
+            GLint success;
+            glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &success);
+            if (!success)
             {
                 if constexpr (is_debug == true)
                 {
                     GLsizei len;
-                    glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &len);
+                    glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &len);
 
                     GLchar *log = new GLchar[len + 1];
-                    glGetProgramInfoLog(prog, len, &len, log);
-                    std::cerr << "Shader linking failed: " << log << std::endl;
+                    glGetShaderInfoLog(shaders[i], len, &len, log);
+                    std::cerr << "Shader compilation failed: " << log << std::endl;
                     delete[] log;
                 }
-                return 0;
+                ok = false;
             }
-            //在把着色器对象链接到程序对象以后，记得删除着色器对象，我们不再需要它们了
-            for (auto j = shaders.begin(); j != shaders.end() && j->type != GL_NONE; j++)
+        }
+
+        // check for linking errors
+        GLint linked;
+        glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+        if (ok && !linked)
+        {
+            if constexpr (is_debug == true)
             {
-                glDeleteShader(j->shader);
-                j->shader = 0;
+                GLsizei len;
+                glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &len);
+
+                GLchar *log = new GLchar[len + 1];
+                glGetProgramInfoLog(prog, len, &len, log);
+                std::cerr << "Shader linking failed: " << log << std::endl;
+                delete[] log;
             }
+            ok = false;
+        }
 
-            return prog;
-        };
+        //在把着色器对象链接到程序对象以后，记得删除着色器对象，我们不再需要它们了
+        for (GLsizei i = 0; i < count; i++)
+        {
+            glDetachShader(prog, shaders[i]);
+            glDeleteShader(shaders[i]);
+        }
+        if (!ok)
+        {
+            glDeleteProgram(prog);
+            return 0;
+        }
+        return prog;
+    };
 
-        auto shaders = std::vector<ShaderInfo>{
-            {GL_VERTEX_SHADER, vert_glsl}, {GL_FRAGMENT_SHADER, frag_glsl}, {GL_NONE, ""}};
+    GLuint create_link_program(std::string &vert_glsl, std::string &frag_glsl)
+    {
+        return create_link_programs({{vert_glsl, frag_glsl}}).front();
+    };
 
-        GLuint program = LoadShaders(shaders);
-        return program;
+    std::vector<GLuint> create_link_programs(const std::vector<std::pair<std::string, std::string>> &sources)
+    {
+        // every compile first, then every link, the status of any of them is only queried at the end
+        std::vector<std::array<GLuint, 2>> shaders;
+        shaders.reserve(sources.size());
+        for (auto &src : sources)
+            shaders.push_back({compile_begin(GL_VERTEX_SHADER, src.first), compile_begin(GL_FRAGMENT_SHADER, src.second)});
+
+        std::vector<GLuint> programs;
+        programs.reserve(sources.size());
+        for (auto &s : shaders)
+            programs.push_back(link_begin(s));
+
+        for (auto &prog : programs)
+            prog = link_end(prog);
+        return programs;
     };
+
     void del_program(GLuint prog)
     {
         glDeleteProgram(prog);
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <glad/glad.h>
 
@@ -28,6 +30,9 @@ namespace shaders
 {
     std::basic_string<GLchar> ReadShader_fromfile(std::string filename);
     GLuint create_link_program(std::string &vert_glsl, std::string &frag_glsl);
+    // 批量编译: 先提交所有program的compile/link，最后才检查状态，使驱动可以并行编译。
+    // sources: {vert_glsl, frag_glsl} 列表; 返回对应的program，失败的为0
+    std::vector<GLuint> create_link_programs(const std::vector<std::pair<std::string, std::string>> &sources);
 
     // vertices 每行代表一个vertex， 一个vertex可能包含一个或多个vertex attrib
     //  通过输入howto_do信息告诉gpu如何分析每个vertex attrib
@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <limits>
@@ -19,8 +21,15 @@ class mydraw_t : public drawarea_base_t
 {
 public:
    // member
-   shaders::prog_t lightingShader_prog, lightCubeShader_prog;
+   shaders::shaderVariants_t shaderVariants;
+   shaders::prog_t *lightingShader_prog = nullptr; // owned by shaderVariants
+   shaders::prog_t *instancedShader_prog = nullptr; // owned by shaderVariants
+   shaders::prog_t lightCubeShader_prog;
    shaders::model_t cubeModel, planeModel;
+   // optional model from MYGLUTIL_SCENE, streamed in by loadModelAsync; once complete its arenas are drawn with multi-draw indirect
+   shaders::model_t sceneModel;
+   // projection/view shared by every program declaring `uniform Camera`
+   shaders::uniformBlock_t cameraBlock{"Camera", 0};
 
 public:
    mydraw_t(BaseObjectType *cobject, const Glib::RefPtr<Gtk::Builder> &builder)
@@ -105,6 +114,13 @@ private:
       try
       {
          throw_if_error();
+         // frame boundary: swap in shaders reloaded by the watcher
+         shaders::shaderWatcher_t::instance().poll();
+         // uploads of streamed models, at most ~2ms per frame; keep frames coming until the queue is empty
+         auto &uploads = shaders::uploadQueue_t::instance();
+         uploads.drain(std::chrono::milliseconds(2));
+         if (uploads.pending() > 0 || sceneModel.streaming())
+            this->queue_render();
          // glViewport(0, 0, this->get_width(), this->get_height());
 
          // glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
@@ -113,37 +129,31 @@ private:
 
          //   glClear (GL_COLOR_BUFFER_BIT);
 
-         // be sure to activate shader when setting uniforms/drawing objects
-         lightingShader_prog.use();
-         // view/projection transformations
-
-         auto projection = trans::perspective(radians(thecamera.Zoom),
-                                              (float)SCR_WIDTH / (float)SCR_HEIGHT,
-                                              0.1f, 100.0f);
-         auto view = thecamera.GetViewMatrix();
-         Eigen::Affine3f model;
-         model = Eigen::Translation3f(-1.0f, 0.0f, -1.0f); //* Eigen::Scaling(1.0f, 1.0f, 1.0f);
-         lightingShader_prog.uniform_set<Eigen::Matrix4f>({
-             {"projection", projection},
-             {"view", view},
-             {"model", model.matrix()},
-         });
-         // render the cube
-         cubeModel.Draw(lightingShader_prog);
-
-         model = Eigen::Translation3f(2.0f, 0.0f, 0.0f);
-         lightingShader_prog.uniform_set<Eigen::Matrix4f>({
-             {"model", model.matrix()},
-         });
-         // render the cube
-         cubeModel.Draw(lightingShader_prog);
+         // view/projection transformations, uploaded once per frame for all programs
+         cameraBlock.set("projection", trans::perspective(radians(thecamera.Zoom),
+                                                          (float)SCR_WIDTH / (float)SCR_HEIGHT,
+                                                          0.1f, 100.0f));
+         cameraBlock.set("view", thecamera.GetViewMatrix());
+         cameraBlock.upload();
+
+         // both cubes in one instanced draw, the model matrices are per-instance attributes
+         instancedShader_prog->use();
+         std::vector<Eigen::Matrix4f> cubes{
+             Eigen::Affine3f(Eigen::Translation3f(-1.0f, 0.0f, -1.0f)).matrix(),
+             Eigen::Affine3f(Eigen::Translation3f(2.0f, 0.0f, 0.0f)).matrix(),
+         };
+         cubeModel.DrawInstanced(*instancedShader_prog, cubes);
 
+         // be sure to activate shader when setting uniforms/drawing objects
+         lightingShader_prog->use();
          //floor
-         lightingShader_prog.uniform_set<Eigen::Matrix4f>({
+         lightingShader_prog->uniform_set<Eigen::Matrix4f>({
              {"model", Eigen::Matrix4f::Identity()},
          });
          // render the cube
-         planeModel.Draw(lightingShader_prog);
+         planeModel.Draw(*lightingShader_prog);
+         // the submeshes of the streamed model that have arrived so far
+         sceneModel.Draw(*lightingShader_prog);
          // swapbuffers(this->m_state);
          // base::OnDraw();
          // std::cout << "draw" << std::endl;
@@ -171,47 +181,27 @@ private:
       this->lastX = this->get_width() / 2.0f;
       this->lastY = this->get_height() / 2.0f;
 
+      // hot reload of the shader variants below, including their #include files
+      shaders::shaderWatcher_t::instance().start();
+
       glEnable(GL_DEPTH_TEST);
       thecamera = cv::camera_t(Eigen::Vector3f(0.0f, 0.0f, 3.0f));
 
+      // must exist before the programs are linked, so that they are bound to it automatically
+      cameraBlock.declare<Eigen::Matrix4f>("projection").declare<Eigen::Matrix4f>("view");
+      cameraBlock.create();
+
       // build and compile our shader zprogram
       // ------------------------------------
-      auto r = lightingShader_prog.load(
-          R"(
-            #version 330 core
-            // #version 330
-            layout (location = 0) in vec3 aPos;
-            layout (location = 1) in vec2 aTexCoords;
+      shaderVariants.add_include_dir("../../resources/shaders");
+      lightingShader_prog = shaderVariants.getFromPath("../../resources/shaders/textured.vert",
+                                                       "../../resources/shaders/textured.frag",
+                                                       {{"USE_TEXTURE", "1"}});
+      instancedShader_prog = shaderVariants.getFromPath("../../resources/shaders/textured.vert",
+                                                        "../../resources/shaders/textured.frag",
+                                                        {{"USE_TEXTURE", "1"}, {"INSTANCED", "1"}});
 
-            out vec2 TexCoords;
-
-            uniform mat4 model;
-            uniform mat4 view;
-            uniform mat4 projection;
-
-            void main()
-            {
-               TexCoords = aTexCoords;
-               gl_Position = projection * view * model * vec4(aPos, 1.0);
-            }
-         )",
-          R"(
-            #version 330 core
-            // #version 330
-            out vec4 FragColor;
-
-            in vec2 TexCoords;
-
-            uniform sampler2D texture1;
-
-            void main()
-            {
-               FragColor = texture(texture1, TexCoords);
-            }
-
-      )");
-
-      assert(r == true);
+      assert(lightingShader_prog != nullptr && instancedShader_prog != nullptr);
 
       try
       {
@@ -277,38 +267,40 @@ private:
           -5.0f, -0.5f, -5.0f, 0.0f, 2.0f,
           5.0f, -0.5f, -5.0f, 2.0f, 2.0f};
 
-      cubeModel.loadNativeData(5,
-                               {
-                                   {shaders::vertexType_t::POSITION_ENU, 0},
-                                   {shaders::vertexType_t::TEXCOORD_ENU, 3},
-                               },
-                               cubeNative,
-                               {
-                                   {aiTextureType_HEIGHT, "../../resources/textures/marble.jpg"},
-                               });
-
-      planeModel.loadNativeData(5,
-                                {
-                                    {shaders::vertexType_t::POSITION_ENU, 0},
-                                    {shaders::vertexType_t::TEXCOORD_ENU, 3},
-                                },
-                                planeNative,
-                                {
-                                    {aiTextureType_HEIGHT, "../../resources/textures/metal.png"},
-                                });
-
-      lightingShader_prog.use();
-      lightingShader_prog.uniform_set<GLuint>({
+      // only positions and texture coords are uploaded and enabled, the layout is fixed at compile time
+      using textured_t = shaders::vertexLayout_t<shaders::attrib::position_t, shaders::attrib::texcoord_t>;
+      // the flat arrays repeat every shared corner, weld them and draw indexed
+      cubeModel.weldVertices = planeModel.weldVertices = true;
+      cubeModel.loadNativeData<textured_t>(cubeNative,
+                                           {
+                                               {aiTextureType_HEIGHT, "../../resources/textures/marble.jpg"},
+                                           });
+
+      planeModel.loadNativeData<textured_t>(planeNative,
+                                            {
+                                                {aiTextureType_HEIGHT, "../../resources/textures/metal.png"},
+                                            });
+
+      lightingShader_prog->use();
+      lightingShader_prog->uniform_set<GLuint>({
+          {"texture1", 0},
+      });
+      instancedShader_prog->use();
+      instancedShader_prog->uniform_set<GLuint>({
           {"texture1", 0},
       });
-      // glBindAttribLocation(lightingShader_prog.progid, 0, "aPos");
-      // glBindAttribLocation(lightingShader_prog.progid, 1, "aTexCoords");
+      if (auto scene = std::getenv("MYGLUTIL_SCENE"))
+         sceneModel.loadModelAsync(scene);
+      // glBindAttribLocation(lightingShader_prog->progid, 0, "aPos");
+      // glBindAttribLocation(lightingShader_prog->progid, 1, "aTexCoords");
 
       std::cout << "---trigger on_selfrealize end;" << std::endl;
    }
 
    void on_selfunrealize()
    {
+      // the context is still current: cancel the pending uploads while their GL objects can be deleted
+      shaders::uploadQueue_t::instance().cancel();
       std::cout << "---trigger on_selfunrealize end;" << std::endl;
       // if (gtk_gl_area_get_error(this->gobj()) != NULL)
       //    return;
@@ -0,0 +1,14 @@
+#include <epoxy/gl.h>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#define MYGLUTILITY__IMPLEMENTATION
+#include <myglutil.hpp>
+#define MYEGL_UTILITY__IMPLEMENTATION
+#include <myeglutil.hpp>
+
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
@@ -0,0 +1,264 @@
+#include <epoxy/gl.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <myglutil.hpp>
+#include <myeglutil.hpp>
+
+/**
+ * shaderbake: 离屏(无窗口)预编译manifest中的全部shader，校验编译/链接，并写入program binary缓存，
+ * 部署后的渲染节点首次启动即可命中缓存，不再付出驱动JIT编译的开销。
+ *
+ * usage:
+ *   shaderbake [-o cache_dir] [-I include_dir]... [-f] manifest
+ *     -o  缓存目录，缺省同shaders::cache_root()（可用环境变量MYGLUTIL_CACHE_DIR修改）
+ *     -I  额外的#include查找目录，manifest所在目录总是第一个
+ *     -f  即使已经命中缓存也重新编译
+ *
+ * manifest每行一个program，'#'开头为注释，路径相对manifest所在目录：
+ *   name  vert  frag                        与 prog_t::loadFromPath 加载的源码一致
+ *   name  vert  frag  NAME=VALUE ...        与 shaderVariants_t::getFromPath 的变体一致(预处理后)
+ *   name  vert  frag  -                     没有define的shaderVariants_t变体
+ *
+ * 注意：缓存key包含GL_VENDOR/GL_RENDERER/GL_VERSION，需要在与渲染节点相同的驱动上运行；
+ * 离屏context是core profile，请求3.3，驱动通常返回与应用相同的最高版本。
+ **/
+
+struct entry_t
+{
+   std::string name;
+   std::filesystem::path vert, frag;
+   bool variant = false;
+   shaders::shaderVariants_t::defines_t defines;
+};
+
+static bool parse_manifest(const std::filesystem::path &manifest, std::vector<entry_t> &entries)
+{
+   std::ifstream in(manifest);
+   if (!in)
+   {
+      std::cerr << manifest << ": cannot open manifest" << std::endl;
+      return false;
+   }
+
+   auto dir = manifest.parent_path();
+   std::string text;
+   int line = 0;
+   bool ok = true;
+   while (std::getline(in, text))
+   {
+      line++;
+      auto hash = text.find('#');
+      if (hash != std::string::npos)
+         text.resize(hash);
+
+      std::istringstream tokens(text);
+      entry_t e;
+      std::string vert, frag, def;
+      if (!(tokens >> e.name))
+         continue;
+      if (!(tokens >> vert >> frag))
+      {
+         std::cerr << manifest.string() << ":" << line << ": expected `name vert frag [DEFINES]`" << std::endl;
+         ok = false;
+         continue;
+      }
+      e.vert = dir / vert;
+      e.frag = dir / frag;
+      while (tokens >> def)
+      {
+         e.variant = true;
+         if (def == "-")
+            continue;
+         auto eq = def.find('=');
+         if (eq == std::string::npos)
+            e.defines.emplace_back(def, "1");
+         else
+            e.defines.emplace_back(def.substr(0, eq), def.substr(eq + 1));
+      }
+      entries.push_back(std::move(e));
+   }
+   return ok;
+}
+
+static bool check_compile(GLuint shader, const entry_t &e, const char *stage)
+{
+   GLint success = GL_FALSE;
+   glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+   if (success)
+      return true;
+
+   GLsizei len = 0;
+   glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &len);
+   std::vector<GLchar> log(len + 1);
+   glGetShaderInfoLog(shader, len, &len, log.data());
+   std::cerr << e.name << ": " << stage << " compilation failed: " << log.data() << std::endl;
+   return false;
+}
+
+static GLuint compile(GLenum type, const std::string &glsl)
+{
+   GLuint shader = glCreateShader(type);
+   auto source = glsl.c_str();
+   glShaderSource(shader, 1, &source, NULL);
+   glCompileShader(shader);
+   return shader;
+}
+
+int main(int argc, char *argv[])
+{
+   using clock_t = std::chrono::steady_clock;
+   auto ms = [](clock_t::duration d)
+   { return std::chrono::duration<double, std::milli>(d).count(); };
+
+   std::filesystem::path manifest, cache_dir;
+   std::vector<std::filesystem::path> include_dirs;
+   bool force = false;
+   for (int i = 1; i < argc; i++)
+   {
+      if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+         cache_dir = argv[++i];
+      else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc)
+         include_dirs.push_back(argv[++i]);
+      else if (strcmp(argv[i], "-f") == 0)
+         force = true;
+      else if (manifest.empty() && argv[i][0] != '-')
+         manifest = argv[i];
+      else
+      {
+         manifest.clear();
+         break;
+      }
+   }
+   if (manifest.empty())
+   {
+      std::cerr << "usage: " << argv[0] << " [-o cache_dir] [-I include_dir]... [-f] manifest" << std::endl;
+      return 2;
+   }
+
+   std::vector<entry_t> entries;
+   if (parse_manifest(manifest, entries) == false)
+      return 1;
+
+   egl_state_t egl;
+   if (prepare_Surfaceless(egl) == false && prepare_PBuffer(16, 16, egl) == false)
+   {
+      std::cerr << "cannot create an offscreen GL context" << std::endl;
+      return 1;
+   }
+   std::cout << "GL_RENDERER: " << glGetString(GL_RENDERER) << std::endl;
+   std::cout << "GL_VERSION:  " << glGetString(GL_VERSION) << std::endl;
+
+   auto &cache = shaders::binaryCache_t::instance();
+   if (cache_dir.empty() == false)
+      cache.set_directory(cache_dir);
+   if (cache.enabled() == false)
+      std::cout << "warning: no program binary formats, shaders are validated but not cached" << std::endl;
+
+   shaders::shaderVariants_t variants;
+   variants.add_include_dir(manifest.parent_path());
+   for (auto &d : include_dirs)
+      variants.add_include_dir(d);
+
+   std::size_t failures = 0, cached = 0, built = 0;
+   double total_compile = 0, total_link = 0;
+   std::printf("%-24s %12s %12s  %s\n", "program", "compile(ms)", "link(ms)", "result");
+   for (auto &e : entries)
+   {
+      auto v = shaders::prog_t::readShader_fromfile(e.vert);
+      auto f = shaders::prog_t::readShader_fromfile(e.frag);
+      if (v.empty() || f.empty())
+      {
+         std::printf("%-24s %12s %12s  %s\n", e.name.c_str(), "-", "-", "missing source");
+         failures++;
+         continue;
+      }
+      // same text the runtime hands to binaryCache_t, otherwise the keys would not match
+      if (e.variant)
+      {
+         v = variants.preprocess(v, e.defines, e.vert);
+         f = variants.preprocess(f, e.defines, e.frag);
+         if (v.empty() || f.empty())
+         {
+            std::printf("%-24s %12s %12s  %s\n", e.name.c_str(), "-", "-", "preprocess failed");
+            failures++;
+            continue;
+         }
+      }
+
+      if (force == false && cache.enabled())
+      {
+         GLuint hit = cache.load(v, f);
+         if (hit != 0)
+         {
+            glDeleteProgram(hit);
+            std::printf("%-24s %12s %12s  %s\n", e.name.c_str(), "-", "-", "cached");
+            cached++;
+            continue;
+         }
+      }
+
+      // the status queries wait for the driver, so each phase is timed to completion
+      auto t0 = clock_t::now();
+      GLuint vs = compile(GL_VERTEX_SHADER, v);
+      GLuint fs = compile(GL_FRAGMENT_SHADER, f);
+      bool ok = check_compile(vs, e, "vertex");
+      ok = check_compile(fs, e, "fragment") && ok;
+      auto t1 = clock_t::now();
+
+      GLuint prog = 0;
+      if (ok)
+      {
+         prog = glCreateProgram();
+         if (cache.enabled())
+            glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+         glAttachShader(prog, vs);
+         glAttachShader(prog, fs);
+         glLinkProgram(prog);
+         GLint linked = GL_FALSE;
+         glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+         if (!linked)
+         {
+            GLsizei len = 0;
+            glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &len);
+            std::vector<GLchar> log(len + 1);
+            glGetProgramInfoLog(prog, len, &len, log.data());
+            std::cerr << e.name << ": linking failed: " << log.data() << std::endl;
+            ok = false;
+         }
+      }
+      auto t2 = clock_t::now();
+      glDeleteShader(vs);
+      glDeleteShader(fs);
+
+      const char *result = "FAILED";
+      if (ok)
+      {
+         result = cache.enabled() == false ? "ok (not cached)" : cache.store(prog, v, f) ? "ok" : "ok (store failed)";
+         built++;
+      }
+      else
+         failures++;
+      if (prog != 0)
+         glDeleteProgram(prog);
+
+      total_compile += ms(t1 - t0);
+      total_link += ms(t2 - t1);
+      std::printf("%-24s %12.2f %12.2f  %s\n", e.name.c_str(), ms(t1 - t0), ms(t2 - t1), result);
+   }
+
+   std::printf("%-24s %12.2f %12.2f  %zu built, %zu cached, %zu failed\n", "total",
+               total_compile, total_link, built, cached, failures);
+   std::cout << "cache directory: " << cache.directory() << std::endl;
+
+   release_eglstate(egl);
+   return failures == 0 ? 0 : 1;
+}